@@ -2,6 +2,7 @@
 #include <ltl/persist.hpp>
 #include <ltl/date_time.hpp>
 #include <scrypt/base64.hpp>
+#include <boost/lexical_cast.hpp>
 #include <log/log.hpp>
 
 
@@ -103,18 +104,31 @@ int64_t  account::get_pending_balance()const {
   return b;
 }
 
+/**
+ *  Like the pending balance but offers are left out, they hold their funds
+ *  in the funds_ledger until they are filled or closed.
+ */
+int64_t  account::get_unreserved_balance()const {
+  int64_t b = m_balance;
+  const trx_collection* boxes[] = { &m_applied, &m_out_box };
+  for( uint32_t i = 0; i < 2; ++i ) {
+    for( trx_collection::const_iterator itr = boxes[i]->begin(); itr != boxes[i]->end(); ++itr ) {
+      const std::vector<action::ptr>& acts = (*itr)->get_actions();
+      for( uint32_t a = 0; a < acts.size(); ++a )
+        if( acts[a]->type() != "offer" )
+          b += acts[a]->apply( get_id() );
+    }
+  }
+  return b;
+}
+
 boost::posix_time::ptime  account::balance_date()const {
   return to_ptime( m_date );
 }
 
 
 const std::vector<uint64_t>& account::new_sig_ids()const {
-  if( !m_onew_sig_ids ) {
-    std::string data = scrypt::base64_decode( m_sig_nums );
-    m_onew_sig_ids = std::vector<uint64_t>();
-    (*m_onew_sig_ids).resize(data.size()/sizeof(uint64_t) );
-    memcpy( (char*)&(*m_onew_sig_ids).front(), data.c_str(), data.size() );
-  }
+  if( !m_onew_sig_ids ) load_sig_numbers();
   return *m_onew_sig_ids;
 }
 
@@ -150,21 +164,36 @@ std::vector<uint64_t> account::find_unused_sig_ids()const {
   std::vector<uint64_t> ids = sig_ids();
   std::vector<uint64_t> uids = find_used_sig_ids();
   for( uint32_t i = 0; i < uids.size(); ++i )
-    std::remove(ids.begin(), ids.end(),uids[i]);
+    ids.erase( std::remove(ids.begin(), ids.end(),uids[i]), ids.end() );
   return ids;
 }
 
 
 const std::vector<uint64_t>& account::sig_ids()const {
-  if( !m_osig_ids ) {
-    std::string data = scrypt::base64_decode( m_sig_nums );
-    m_osig_ids = std::vector<uint64_t>();
-    (*m_osig_ids).resize(data.size()/sizeof(uint64_t) );
-    memcpy( (char*)&(*m_osig_ids).front(), data.c_str(), data.size() );
-  }
+  if( !m_osig_ids ) load_sig_numbers();
   return *m_osig_ids;
 }
 
+/**
+ *  Reads the sig_number rows of the account once, later changes keep
+ *  the lists and rows in step one number at a time.
+ */
+void account::load_sig_numbers()const {
+  m_osig_ids     = std::vector<uint64_t>();
+  m_onew_sig_ids = std::vector<uint64_t>();
+  m_sig_rows.clear();
+  for( sig_collection::const_iterator itr = m_sig_numbers.begin(); itr != m_sig_numbers.end(); ++itr ) {
+    m_sig_rows[(*itr)->num] = *itr;
+  }
+  // the map orders both lists
+  for( sig_rows::const_iterator itr = m_sig_rows.begin(); itr != m_sig_rows.end(); ++itr ) {
+    if( itr->second->state == sig_number::reserved )
+      m_osig_ids->push_back( itr->first );
+    else
+      m_onew_sig_ids->push_back( itr->first );
+  }
+}
+
 
 bool account::is_valid()const {
   if( !m_host || !m_owner || !m_type ) 
@@ -237,8 +266,7 @@ bool account::owner_signed()const {
  */
 void account::allocate_signature_numbers( const std::vector<uint64_t>& signums, const signature& host_sig ) {
   std::vector<uint64_t>   used_sig = find_used_sig_ids(); 
-  if( !m_onew_sig_ids ) 
-    m_onew_sig_ids = std::vector<uint64_t>();
+  new_sig_ids();
 
   std::vector<uint64_t>&  new_sigs = *m_onew_sig_ids;
 
@@ -246,18 +274,23 @@ void account::allocate_signature_numbers( const std::vector<uint64_t>& signums,
     if( used_sig.end() != std::find( used_sig.begin(), used_sig.end(), signums[i] ) ) {
       LTL_THROW( "Signature number %1% is currently in use", %signums[i] );
     } 
-    if( new_sigs.end() == std::find( new_sigs.begin(), new_sigs.end(), signums[i] ) )
-      new_sigs.push_back(signums[i]);
-  }
+    if( m_sig_rows.count( signums[i] ) )
+      continue;
 
-  // store the new sig nums into m_new_sig_nums
-  if( new_sigs.size() )
-      m_new_sig_nums = scrypt::base64_encode( (const unsigned char*)&new_sigs.front(), new_sigs.size()*sizeof(uint64_t) );
-  else 
-      m_new_sig_nums = "";
+    // one new row per number, the others are left as they are
+    m_sig_rows[signums[i]] = session()->add( new sig_number( self(), signums[i] ) );
+    new_sigs.insert( std::lower_bound( new_sigs.begin(), new_sigs.end(), signums[i] ), signums[i] );
+  }
 }
 
 
+/**
+ *  Transactions applied by the host, such as fills, carry no number.
+ */
+static std::string sig_num_string( const boost::optional<uint64_t>& sid ) {
+  return sid ? boost::lexical_cast<std::string>( *sid ) : std::string( "host" );
+}
+
 /**
  *  @brief provides human-readable debug output for the account.
  *
@@ -307,7 +340,7 @@ std::string account::to_string()const {
     ss << std::left << std::setw(10) << (b += delta);
     std::stringstream ss2; ss2 << (*itr)->get_date(); 
     ss << std::left << std::setw(25) << ss2.str();
-    ss << std::left << std::setw(20) << *((*itr)->get_signature_num_for( get_id() )); 
+    ss << std::left << std::setw(20) << sig_num_string( (*itr)->get_signature_num_for( get_id() ) ); 
     ss << "\n";
     ++itr;
   }
@@ -320,7 +353,7 @@ std::string account::to_string()const {
     ss << std::left << std::setw(10) << (b += delta);
     std::stringstream ss2; ss2 << (*itr)->get_date(); 
     ss << std::left << std::setw(25) << ss2.str();
-    ss << std::left << std::setw(20) << *((*itr)->get_signature_num_for( get_id() )); 
+    ss << std::left << std::setw(20) << sig_num_string( (*itr)->get_signature_num_for( get_id() ) ); 
     ss << "\n";
     ++itr;
   }
@@ -402,23 +435,21 @@ void account::host_accept_balance( const signature& owner_sig, int64_t new_bal,
    // TODO: check all applied trx to see if refcount == 0, then erase!
     slog( "open_sig_ids %1%   open new sig ids %2%", open_sig_ids.size(), open_new_sig_ids.size() );
   
-    const std::vector<uint64_t>& ccur_sids = sig_ids();
+    // only the numbers that changed state are written
     std::vector<uint64_t>& cur_sids = *m_osig_ids;
-
-    cur_sids.resize(0);
-    cur_sids.insert( cur_sids.begin(), open_sig_ids.begin(), open_sig_ids.end() );
-  
+    for( uint32_t i = 0; i < cur_sids.size(); ++i ) {
+      if( !open_sig_ids.count( cur_sids[i] ) ) {
+        m_sig_rows[cur_sids[i]].remove();
+        m_sig_rows.erase( cur_sids[i] );
+      }
+    }
+    for( std::set<uint64_t>::const_iterator itr = open_sig_ids.begin(); itr != open_sig_ids.end(); ++itr ) {
+      sig_rows::iterator r = m_sig_rows.find( *itr );
+      if( r != m_sig_rows.end() && r->second->state != sig_number::reserved )
+        r->second.modify()->state = sig_number::reserved;
+    }
+    cur_sids.assign( open_sig_ids.begin(), open_sig_ids.end() );
     m_onew_sig_ids = open_new_sig_ids;
-    if( open_new_sig_ids.size() )
-       m_new_sig_nums = scrypt::base64_encode( (const unsigned char*)&open_new_sig_ids.front(), open_new_sig_ids.size() * sizeof( uint64_t ) );
-    else
-       m_new_sig_nums = "";
-   
-
-    if( open_sig_ids.size() ) 
-       m_sig_nums = scrypt::base64_encode( (const unsigned char*)&cur_sids.front(), cur_sids.size() * sizeof( uint64_t ) );
-    else
-       m_sig_nums = "";
 
     BOOST_ASSERT( owner_signed() );
 }
@@ -442,14 +473,15 @@ void account::get_accept_balance_digest(  const boost::posix_time::ptime& new_ba
     }
    
     const std::vector<uint64_t>& nsids = new_sig_ids();
+    open_new_sig_ids = nsids;
     // make sure new_sig_nums is a subset of new_sig_ids
     for( uint32_t i = 0; i < new_sig_nums.size(); ++i ) {
-     // TODO: sig nums should always be stored in assending order... for hashing purposes
-     if( std::find( nsids.begin(), nsids.end(), new_sig_nums[i] ) == nsids.end() ) {
+     if( !std::binary_search( nsids.begin(), nsids.end(), new_sig_nums[i] ) ) {
        LTL_THROW( "Signature number %1% was not issued by host", %new_sig_nums[i] );
      }
      open_sig_ids.insert( new_sig_nums[i] );
-     std::remove( open_new_sig_ids.begin(), open_new_sig_ids.end(), new_sig_nums[i] );
+     open_new_sig_ids.erase( std::remove( open_new_sig_ids.begin(), open_new_sig_ids.end(), new_sig_nums[i] ),
+                             open_new_sig_ids.end() );
     }
    
     const std::vector<uint64_t>& cur_sids = sig_ids();
@@ -469,7 +501,9 @@ void account::get_accept_balance_digest(  const boost::posix_time::ptime& new_ba
        if( mitr == mtrx.end() ) {
          LTL_THROW( "Unknown applied transaction id %1%", %std::string(applied_trx_ids[i]) );
        }
-       open_sig_ids.erase( *mitr->second->get_signature_num_for( get_id() ) );
+       // fill transactions are applied by the host and use no signature number
+       boost::optional<uint64_t> sid = mitr->second->get_signature_num_for( get_id() );
+       if( sid ) open_sig_ids.erase( *sid );
        delta_b += mitr->second->apply( get_id() );
     }
     newbal = balance() + delta_b;
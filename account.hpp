@@ -4,6 +4,7 @@
 #include <ltl/crypto.hpp>
 #include <stdint.h>
 #include <vector>
+#include <map>
 
 namespace ltl {
 
@@ -16,6 +17,7 @@ namespace ltl {
   class account : public dbo::Dbo<account>, public dbo::ptr<account> {
     public:
       typedef dbo::collection<dbo::ptr<transaction> > trx_collection;
+      typedef dbo::collection<dbo::ptr<sig_number> >  sig_collection;
       typedef std::map<sha1, dbo::ptr<transaction> > mtrx_map;
 
       account(){}
@@ -37,6 +39,8 @@ namespace ltl {
       // balance after all applied and/or out box transactions
       int64_t                get_applied_balance()const;
       int64_t                get_pending_balance()const;
+      // pending balance without the funds held by offers, see funds_ledger
+      int64_t                get_unreserved_balance()const;
 
       int64_t                   balance()const;
       boost::posix_time::ptime  balance_date()const;
@@ -52,6 +56,9 @@ namespace ltl {
        * are valid.  Each signature number may only be used once
        * and is then removed from the balance agreement after
        * the transaction it was applied to has been cleared.
+       *
+       * Both lists are sorted.  Each number is a sig_number row of its
+       * own, issuing or consuming one writes only that row.
        */
       ///@{
       const std::vector<uint64_t>& sig_ids()const;
@@ -92,12 +99,17 @@ namespace ltl {
                                        const signature& host_sig );
 
     private:
+      typedef std::map<uint64_t, dbo::ptr<sig_number> > sig_rows;
+
       void    set_signature( std::string&, const signature& sig );
+      void    load_sig_numbers()const;
+
       mutable boost::optional<sha1>                    m_oid;
       mutable boost::optional<signature>               m_oowner_sig;
       mutable boost::optional<signature>               m_ohost_sig;
-      mutable boost::optional<std::vector<uint64_t> >  m_osig_ids;
-      mutable boost::optional<std::vector<uint64_t> >  m_onew_sig_ids;
+      mutable boost::optional<std::vector<uint64_t> >  m_osig_ids;     // reserved, loaded with m_sig_rows
+      mutable boost::optional<std::vector<uint64_t> >  m_onew_sig_ids; // issued, loaded with m_sig_rows
+      mutable sig_rows                                 m_sig_rows;
 
 
       trx_collection m_in_box;
@@ -113,8 +125,7 @@ namespace ltl {
 
       long long             m_balance;
       long long             m_date;
-      std::string           m_sig_nums;         // base64( std::vector<uint64_t> )
-      std::string           m_new_sig_nums; // base64( std::vector<uint64_t> )
+      sig_collection        m_sig_numbers;
 
       // owner.sign( sha1( json(owner.id, asset.id, host.id, balance, date, sig_num) ), owner_sig )
       std::string           m_owner_sig; // base64( signature )
@@ -124,6 +135,32 @@ namespace ltl {
 
   };
 
+  /**
+   *  @ingroup ltl_dbo
+   *
+   *  A signature number the host has issued to an account.  It is
+   *  reserved once the owner has included it in a balance agreement and
+   *  removed when the transaction it signed has been cleared.
+   */
+  class sig_number {
+    public:
+      enum state_type {
+        issued   = 0,
+        reserved = 1
+      };
+
+      sig_number():num(0),state(issued){}
+      sig_number( const dbo::ptr<account>& a, uint64_t n, state_type s = issued )
+      :acnt(a),num(n),state(s){}
+
+      template<typename Action>
+      void persist( Action& a );
+
+      dbo::ptr<account>  acnt;
+      long long          num;
+      int                state;
+  };
+
 
 } // namespace ltl
 
@@ -28,10 +28,12 @@ namespace ltl {
 
   action::ptr create_transfer( const json::value& v ) { return boost::shared_ptr<action>(new transfer(v)); }
   action::ptr create_offer( const json::value& v ) { return boost::shared_ptr<action>(new offer(v)); }
+  action::ptr create_trade( const json::value& v ) { return boost::shared_ptr<action>(new trade(v)); }
 
   bool action_factory_init() {
     act_factory()["transfer"] = create_transfer;
     act_factory()["offer"] = create_offer;
+    act_factory()["trade"] = create_trade;
   }
 
   static bool init_action_factory = action_factory_init();
@@ -82,6 +84,7 @@ namespace ltl {
     offer_price  = v["price"];
     start  = to_ptime( (uint64_t) v["start"] );
     end  = to_ptime( (uint64_t) v["end"] );
+    stop_price = v.contains("stop_price") ? (uint64_t)v["stop_price"] : 0;
   }
 
   const std::string& offer::type()const {
@@ -98,6 +101,8 @@ namespace ltl {
     v["price"] = offer_price;
     v["start"] = to_milliseconds(start);
     v["end"] = to_milliseconds(end);
+    if( stop_price )
+      v["stop_price"] = stop_price;
     return v;
   } 
   std::vector<sha1>  offer::required_signatures()const {
@@ -114,4 +119,37 @@ namespace ltl {
   }
 
 
+  trade::trade( const json::value& v ) {
+    offer_trx        = sha1((const std::string&)(v["offer_trx"]));
+    asset_account    = sha1((const std::string&)(v["asset_account"]));
+    currency_account = sha1((const std::string&)(v["currency_account"]));
+    delta_asset      = v["delta_asset"];
+    delta_currency   = v["delta_currency"];
+  }
+
+  const std::string& trade::type()const {
+    static std::string t("trade");
+    return t;
+  }
+  json::value        trade::to_json()const {
+    json::value v;
+    v["offer_trx"]        = std::string( offer_trx );
+    v["asset_account"]    = std::string( asset_account );
+    v["currency_account"] = std::string( currency_account );
+    v["delta_asset"]      = delta_asset;
+    v["delta_currency"]   = delta_currency;
+    return v;
+  }
+  std::vector<sha1>  trade::required_signatures()const {
+    std::vector<sha1> sigs(2);
+    sigs[0] = asset_account;
+    sigs[1] = currency_account;
+    return sigs;
+  }
+  int64_t            trade::apply( const sha1& account )const {
+    if( account == asset_account )    return delta_asset;
+    if( account == currency_account ) return delta_currency;
+    return 0;
+  }
+
 }
@@ -81,7 +81,7 @@ namespace ltl {
   class offer : public action {
     public:
       offer( const json::value& v );
-      offer(){}
+      offer():stop_price(0){}
 
       virtual const std::string&        type()const;
       virtual json::value               to_json()const;
@@ -96,6 +96,7 @@ namespace ltl {
       uint64_t    offer_price;  // units of currency account per asset account
       ptime       start;
       ptime       end;
+      uint64_t    stop_price;   // if not 0 the offer waits until a trade reaches this price
   };
 
   /**
@@ -105,8 +106,15 @@ namespace ltl {
    *  The sum of this trade and all other trades in the chain must be
    *  less than or equal to asset amount and offer price * asset amount
    *
+   *  The market posts one per batch of fills of an order, see
+   *  market_writer, the deltas are the net change of each account: a buy
+   *  has a positive delta_asset and a negative delta_currency.
    */
   class trade : public action {
+    public:
+      trade( const json::value& v );
+      trade():delta_asset(0),delta_currency(0){}
+
       virtual const std::string&        type()const;
       virtual json::value               to_json()const;
       virtual std::vector<sha1>         required_signatures()const;
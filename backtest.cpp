@@ -0,0 +1,141 @@
+#include <ltl/backtest.hpp>
+#include <ltl/market_writer.hpp>
+#include <ltl/persist.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/exception/all.hpp>
+#include <log/log.hpp>
+#include <algorithm>
+
+namespace ltl {
+
+  /**
+   *  Keeps the results of matching in memory instead of writing them.
+   */
+  class backtest_writer : public market_writer {
+    public:
+      struct order_update {
+        long long num_unfilled;
+        int       status;
+      };
+
+      virtual void add_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                              long long num, long long price, long long timestamp,
+                              int implied, bool bridge, const std::string& key ) {
+        backtest_trade t;
+        t.buy_order_id  = buy_order_id;
+        t.sell_order_id = sell_order_id;
+        t.num           = num;
+        t.price         = price;
+        t.timestamp     = timestamp;
+        trades.push_back(t);
+      }
+      virtual void update_order( const std::string& order_id, long long num_unfilled, int status ) {
+        order_update& u = orders[order_id];
+        u.num_unfilled = num_unfilled;
+        u.status       = status;
+      }
+      virtual void amend_order( const std::string& order_id, long long num_unfilled, long long ) {
+        update_order( order_id, num_unfilled, market_order::open );
+      }
+      virtual void flush() {}
+
+      std::vector<backtest_trade>                          trades;
+      boost::unordered_map<std::string, order_update>      orders;
+  };
+
+  class backtest_private {
+    public:
+      backtest_private( long long start, uint32_t tick, const note_links* links )
+      :clock(start),tick_ms(tick),next_tick(start + tick),
+       mark( session, writer, 0, 1, 0, links, 0, &clock ){}
+
+      dbo::Session    session;  // never used, the market is only fed order entries
+      backtest_writer writer;
+      virtual_clock   clock;
+      uint32_t        tick_ms;
+      long long       next_tick;
+      market          mark;
+  };
+
+  backtest::backtest( long long start, uint32_t tick_ms, const note_links* links )
+  :my( new backtest_private( start, tick_ms, links ) ){}
+
+  backtest::~backtest() {
+    delete my;
+  }
+
+  market& backtest::get_market() {
+    return my->mark;
+  }
+
+  const virtual_clock& backtest::clock()const {
+    return my->clock;
+  }
+
+  void backtest::run_until( long long t ) {
+    if( my->tick_ms ) {
+      while( my->next_tick <= t ) {
+        my->clock.set( my->next_tick );
+        my->mark.tick( my->next_tick );
+        my->next_tick += my->tick_ms;
+      }
+    }
+    my->clock.set( t );
+  }
+
+  void backtest::run( const std::vector<backtest_event>& events ) {
+    for( uint32_t i = 0; i < events.size(); ++i ) {
+      const backtest_event& e = events[i];
+      run_until( e.time );
+      try {
+        if( e.kind == backtest_event::new_order )
+          my->mark.submit_order( e.order );
+        else if( e.kind == backtest_event::cancel )
+          my->mark.cancel_order( e.order.id );
+        else if( e.kind == backtest_event::amend )
+          my->mark.amend_order( e.order.id, e.order.num_unfilled, e.order.price );
+      } catch ( const boost::exception& ex ) {
+        wlog( "backtest event %1%: %2%", i, boost::diagnostic_information(ex) );
+      } catch ( const std::exception& ex ) {
+        wlog( "backtest event %1%: %2%", i, boost::diagnostic_information(ex) );
+      }
+    }
+  }
+
+  const std::vector<backtest_trade>& backtest::trades()const {
+    return my->writer.trades;
+  }
+
+  bool backtest::order_state( const std::string& order_id, long long& num_unfilled, int& status )const {
+    boost::unordered_map<std::string, backtest_writer::order_update>::const_iterator itr = my->writer.orders.find( order_id );
+    if( itr == my->writer.orders.end() )
+      return false;
+    num_unfilled = itr->second.num_unfilled;
+    status       = itr->second.status;
+    return true;
+  }
+
+  static bool by_time( const backtest_event& a, const backtest_event& b ) {
+    return a.time < b.time;
+  }
+
+  void backtest::load_events( dbo::Session& s, std::vector<backtest_event>& events ) {
+    typedef dbo::collection<market_order::ptr> market_orders;
+
+    dbo::Transaction dbtrx(s);
+    market_orders mos = s.find<market_order>().orderBy( "rowid" );
+    for( market_orders::const_iterator itr = mos.begin(); itr != mos.end(); ++itr ) {
+      backtest_event e;
+      e.time               = to_milliseconds( (*itr)->order_trx->get_date() );
+      e.order              = market::make_entry( *itr );
+      e.order.num_unfilled = (*itr)->num;
+      events.push_back( e );
+    }
+    dbtrx.commit();
+
+    // transaction dates may be slightly out of arrival order
+    std::stable_sort( events.begin(), events.end(), by_time );
+    slog( "loaded %1% recorded orders", events.size() );
+  }
+
+} // namespace ltl
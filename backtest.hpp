@@ -0,0 +1,92 @@
+#ifndef _LTL_BACKTEST_HPP_
+#define _LTL_BACKTEST_HPP_
+#include <ltl/market.hpp>
+#include <ltl/market_clock.hpp>
+#include <ltl/order_book.hpp>
+#include <vector>
+
+namespace ltl {
+
+  /**
+   *  One recorded change to the order flow.
+   */
+  struct backtest_event {
+    enum kind_type {
+      new_order = 1,
+      cancel    = 2,
+      amend     = 3
+    };
+    backtest_event():time(0),kind(new_order){}
+
+    long long   time;   // utc ms the event reached the market
+    int         kind;
+    order_entry order;  // only the id is used by a cancel, id, num_unfilled and price by an amend
+  };
+
+  struct backtest_trade {
+    std::string buy_order_id;
+    std::string sell_order_id;
+    long long   num;
+    long long   price;
+    long long   timestamp;
+  };
+
+  /**
+   *  Replays recorded order flow through a market driven by a
+   *  virtual_clock instead of the wall clock, as fast as it can be
+   *  matched.
+   *
+   *  The market is the same code the matching_engine runs, but alone on
+   *  the calling thread, without a database or journal, and ticked every
+   *  tick_ms of virtual time the way an engine worker ticks it.  Its
+   *  trades and order updates are recorded in memory.  Replaying the
+   *  same events therefore always produces the same trades and books.
+   */
+  class backtest {
+    public:
+      /**
+       *  @param start virtual time before the first event
+       *  @param tick_ms interval of market::tick(), 0 to only run timers
+       *         when an order arrives
+       */
+      backtest( long long start, uint32_t tick_ms = 100, const note_links* links = 0 );
+      ~backtest();
+
+      /// to set up call auctions or inspect the books between runs
+      market&              get_market();
+      const virtual_clock& clock()const;
+
+      /**
+       *  Feeds events, which must be sorted by time, to the market.
+       *  Orders the market rejects are logged and skipped.
+       */
+      void run( const std::vector<backtest_event>& events );
+
+      /**
+       *  Moves the clock to t, ticking the market on the way.
+       */
+      void run_until( long long t );
+
+      /// every trade so far, in the order they were made
+      const std::vector<backtest_trade>& trades()const;
+
+      /**
+       *  The last update the market made to an order.
+       *  @return false if the order has not traded or been cancelled
+       */
+      bool order_state( const std::string& order_id, long long& num_unfilled, int& status )const;
+
+      /**
+       *  Reads every market_order row as a new_order event at the date of
+       *  its order_trx with its full quantity, in arrival order.  Cancels
+       *  are not recorded by the database and are not replayed.
+       */
+      static void load_events( dbo::Session& s, std::vector<backtest_event>& events );
+
+    private:
+      class backtest_private* my;
+  };
+
+} // namespace ltl
+
+#endif
@@ -12,6 +12,7 @@ namespace ltl {
   class asset_note;
   class transaction;
   class market_order;
+  class sig_number;
 }
 namespace Wt { namespace Dbo {
 
@@ -0,0 +1,156 @@
+#include <ltl/funds_ledger.hpp>
+#include <ltl/market.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace ltl {
+
+  struct account_funds {
+    account_funds():known(false),funds(0),reserved(0),unsettled(0),version(0){}
+
+    bool     known;
+    int64_t  funds;
+    int64_t  reserved;
+    int64_t  unsettled;
+    uint64_t version;  // invalidate() calls
+  };
+
+  struct reservation {
+    std::string account;
+    int         type;
+    int64_t     price;
+    int64_t     num;  // still open
+  };
+
+  class funds_ledger_private {
+    public:
+      typedef boost::mutex::scoped_lock                           scoped_lock;
+      typedef boost::unordered_map<std::string, account_funds>   account_map;
+      typedef boost::unordered_map<std::string, reservation>     order_map;
+
+      mutable boost::mutex m_mutex;
+      account_map          accounts;
+      order_map            orders;
+  };
+
+  funds_ledger::funds_ledger()
+  :my( new funds_ledger_private() ){}
+
+  funds_ledger::~funds_ledger() {
+    delete my;
+  }
+
+  bool funds_ledger::has_funds( const std::string& account )const {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::account_map::const_iterator itr = my->accounts.find( account );
+    return itr != my->accounts.end() && itr->second.known;
+  }
+
+  void funds_ledger::set_funds( const std::string& account, int64_t funds ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    account_funds& af = my->accounts[account];
+    af.known = true;
+    af.funds = funds;
+  }
+
+  void funds_ledger::invalidate( const std::string& account ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::account_map::iterator itr = my->accounts.find( account );
+    if( itr != my->accounts.end() ) {
+      itr->second.known = false;
+      ++itr->second.version;
+    }
+  }
+
+  uint64_t funds_ledger::version( const std::string& account )const {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::account_map::const_iterator itr = my->accounts.find( account );
+    return itr == my->accounts.end() ? 0 : itr->second.version;
+  }
+
+  int64_t funds_ledger::available( const std::string& account )const {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::account_map::const_iterator itr = my->accounts.find( account );
+    if( itr == my->accounts.end() )
+      return 0;
+    return itr->second.funds - itr->second.reserved - itr->second.unsettled;
+  }
+
+  int64_t funds_ledger::required( int type, int64_t price, int64_t num ) {
+    return type == market_order::buy ? price * num : num;
+  }
+
+  void funds_ledger::reserve( const std::string& order_id, const std::string& account,
+                              int type, int64_t price, int64_t num ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    reservation& r = my->orders[order_id];
+    if( r.num ) // reserved twice, keep only the latest
+      my->accounts[r.account].reserved -= required( r.type, r.price, r.num );
+    r.account = account;
+    r.type    = type;
+    r.price   = price;
+    r.num     = num;
+    my->accounts[account].reserved += required( type, price, num );
+  }
+
+  void funds_ledger::fill( const std::string& order_id, int64_t num, int64_t price ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::order_map::iterator itr = my->orders.find( order_id );
+    if( itr == my->orders.end() )
+      return;
+    reservation&   r  = itr->second;
+    account_funds& af = my->accounts[r.account];
+    af.reserved  -= required( r.type, r.price, num );
+    af.unsettled += required( r.type, price, num );
+    r.num        -= num;
+    if( r.num <= 0 )
+      my->orders.erase( itr );
+  }
+
+  bool funds_ledger::amend( const std::string& order_id, int64_t price, int64_t num ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::order_map::iterator itr = my->orders.find( order_id );
+    if( itr == my->orders.end() )
+      return true;
+    reservation&   r     = itr->second;
+    account_funds& af    = my->accounts[r.account];
+    int64_t        delta = required( r.type, price, num ) - required( r.type, r.price, r.num );
+    if( delta > 0 && af.known && af.funds - af.reserved - af.unsettled < delta )
+      return false;
+    af.reserved += delta;
+    r.price      = price;
+    r.num        = num;
+    return true;
+  }
+
+  void funds_ledger::settle( const std::string& account, int64_t num ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    account_funds& af = my->accounts[account];
+    af.unsettled -= num;
+    af.known      = false;
+  }
+
+  void funds_ledger::settle( const std::string& account, int64_t num, int64_t funds, uint64_t version ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    account_funds& af = my->accounts[account];
+    af.unsettled -= num;
+    af.known      = af.version == version;
+    af.funds      = funds;
+  }
+
+  void funds_ledger::release( const std::string& order_id ) {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::order_map::iterator itr = my->orders.find( order_id );
+    if( itr == my->orders.end() )
+      return;
+    my->accounts[itr->second.account].reserved -= required( itr->second.type, itr->second.price, itr->second.num );
+    my->orders.erase( itr );
+  }
+
+  std::string funds_ledger::account_of( const std::string& order_id )const {
+    funds_ledger_private::scoped_lock lock(my->m_mutex);
+    funds_ledger_private::order_map::const_iterator itr = my->orders.find( order_id );
+    return itr == my->orders.end() ? std::string() : itr->second.account;
+  }
+
+} // namespace ltl
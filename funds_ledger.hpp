@@ -0,0 +1,107 @@
+#ifndef _LTL_FUNDS_LEDGER_HPP_
+#define _LTL_FUNDS_LEDGER_HPP_
+#include <stdint.h>
+#include <string>
+
+namespace ltl {
+
+  /**
+   *  Resident record of the funds that open orders hold in each account.
+   *
+   *  A buy reserves price * num of its currency account, a sell reserves
+   *  num of its stock account.  Fills consume the reservation: what was
+   *  traded is held as unsettled until the trade is settled into the
+   *  account balance, and a buy that traded below its limit gets the
+   *  difference back.  Cancelling or expiring an order releases what it
+   *  still holds.
+   *
+   *  The funds of an account are its balance without the effect of any
+   *  offer, the ledger tracks offers itself.  They are supplied by the
+   *  owner of the session through set_funds() whenever they are unknown,
+   *  after which available() is a hash lookup instead of a walk over the
+   *  account's transactions.  invalidate() forgets them again when the
+   *  balance changes for any other reason.
+   *
+   *  Thread safe, the matching threads report fills while the server
+   *  reserves for new orders.
+   */
+  class funds_ledger {
+    public:
+      funds_ledger();
+      ~funds_ledger();
+
+      bool      has_funds( const std::string& account )const;
+      void      set_funds( const std::string& account, int64_t funds );
+      void      invalidate( const std::string& account );
+
+      /**
+       *  @return a count of the account's invalidate() calls, funds read
+       *          after it was taken are current if it has not changed
+       */
+      uint64_t  version( const std::string& account )const;
+
+      /**
+       *  @return funds - reserved - unsettled, only meaningful if
+       *          has_funds( account )
+       */
+      int64_t   available( const std::string& account )const;
+
+      /**
+       *  @return what an order of type (market_order::buy or sell) for
+       *          num at price holds while it is open
+       */
+      static int64_t required( int type, int64_t price, int64_t num );
+
+      /**
+       *  Reserves for the open part of an order.  Nothing is checked, the
+       *  caller has compared available() with required() if it must.
+       */
+      void      reserve( const std::string& order_id, const std::string& account,
+                         int type, int64_t price, int64_t num );
+
+      /**
+       *  Moves num of the order at price from reserved to unsettled, the
+       *  reservation is dropped once the order has been filled.
+       */
+      void      fill( const std::string& order_id, int64_t num, int64_t price );
+
+      /**
+       *  Resizes the reservation of an amended order to num at price.
+       *
+       *  @return false, changing nothing, if that needs more than the
+       *          account has available.  An account whose funds are not
+       *          known cannot be checked and is not refused.
+       */
+      bool      amend( const std::string& order_id, int64_t price, int64_t num );
+
+      /**
+       *  num of the account's unsettled funds has been posted to its
+       *  balance.  The funds are forgotten since the balance changed.
+       */
+      void      settle( const std::string& account, int64_t num );
+
+      /**
+       *  Like settle(), but reseeds the account with funds read after the
+       *  balance was posted unless it was invalidated since version was
+       *  taken.
+       */
+      void      settle( const std::string& account, int64_t num, int64_t funds, uint64_t version );
+
+      /**
+       *  Releases what the order still holds, if anything.
+       */
+      void      release( const std::string& order_id );
+
+      /**
+       *  @return the account the order reserves from, or an empty string
+       *          if it holds nothing
+       */
+      std::string account_of( const std::string& order_id )const;
+
+    private:
+      class funds_ledger_private* my;
+  };
+
+} // namespace ltl
+
+#endif
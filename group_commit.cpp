@@ -0,0 +1,72 @@
+#include <ltl/group_commit.hpp>
+#include <ltl/error.hpp>
+#include <boost/thread/thread.hpp>
+#include <log/log.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace ltl {
+
+  group_commit::group_commit( const boost::filesystem::path& db, uint32_t window_us )
+  :m_wal( db.string() + "-wal" ),m_window_us(window_us),m_requested(0),m_synced(0),m_durable(0),m_syncing(false),m_syncs(0) {
+  }
+
+  void group_commit::wait() {
+    scoped_lock lock(m_mutex);
+    if( m_error.size() ) {
+      LTL_THROW( "Commit is not durable: %1%", %m_error );
+    }
+    // the caller's commits returned before its ticket was taken
+    uint64_t ticket = ++m_requested;
+    while( m_synced < ticket ) {
+      if( m_syncing ) {
+        m_synced_cond.wait( lock );
+        continue;
+      }
+      m_syncing = true;
+      lock.unlock();
+      boost::this_thread::sleep( boost::posix_time::microseconds( m_window_us ) );
+      lock.lock();
+      uint64_t target = m_requested;
+      lock.unlock();
+      std::string error = sync();
+      lock.lock();
+      if( error.size() && m_error.empty() )
+        m_error = error;
+      if( m_error.empty() )
+        m_durable = target;
+      m_synced  = target;
+      m_syncing = false;
+      ++m_syncs;
+      m_synced_cond.notify_all();
+    }
+    if( m_durable < ticket ) {
+      LTL_THROW( "Commit is not durable: %1%", %m_error );
+    }
+  }
+
+  /**
+   *  Flushes the WAL through a descriptor of its own, which flushes the
+   *  pages written through every connection to the database.
+   */
+  std::string group_commit::sync() {
+    std::string error;
+    int fd = ::open( m_wal.string().c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      // no WAL yet, nothing has been committed in WAL mode
+      if( errno == ENOENT )
+        return error;
+      error = "unable to open " + m_wal.string() + ": " + strerror(errno);
+    } else {
+      if( ::fsync( fd ) != 0 )
+        error = "fsync of " + m_wal.string() + " failed: " + strerror(errno);
+      ::close( fd );
+    }
+    if( error.size() )
+      elog( "group commit: %1%", error );
+    return error;
+  }
+
+} // namespace ltl
@@ -0,0 +1,68 @@
+#ifndef _LTL_GROUP_COMMIT_HPP_
+#define _LTL_GROUP_COMMIT_HPP_
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <stdint.h>
+#include <string>
+
+namespace ltl {
+
+  /**
+   *  Makes the commits of concurrent callers durable with one fsync.
+   *
+   *  The database runs in WAL mode with synchronous=NORMAL, so a commit
+   *  only hands its pages to the operating system and a crash can lose
+   *  it but never corrupts the database.  A caller that must not
+   *  acknowledge before its commit is durable calls wait() after
+   *  committing.  The first waiter leads a group: it gives concurrent
+   *  callers window_us to commit and join, then one fsync of the WAL
+   *  makes every commit made before it durable and releases the whole
+   *  group.  Throughput grows with the number of concurrent callers
+   *  instead of being bound by fsync latency.
+   *
+   *  A failed fsync fails every waiter of its group.  The kernel may have
+   *  dropped the pages it could not write, so a later fsync that succeeds
+   *  proves nothing about them: every later wait() fails too until the
+   *  process is restarted and the database recovered.
+   *
+   *  Thread safe.  wait() must not be called with a lock held that other
+   *  committers need, or the group is only ever its leader.
+   */
+  class group_commit {
+    public:
+      /**
+       *  @param db the database file, its WAL is db-wal
+       */
+      group_commit( const boost::filesystem::path& db, uint32_t window_us = 500 );
+
+      /**
+       *  Blocks until every commit the caller made before the call is
+       *  durable, throws if they could not be made durable.
+       */
+      void     wait();
+
+      /// number of fsyncs so far
+      uint64_t syncs()const { return m_syncs; }
+
+    private:
+      typedef boost::mutex::scoped_lock scoped_lock;
+
+      /// @return why the WAL could not be flushed, empty if it was
+      std::string sync();
+
+      boost::filesystem::path   m_wal;
+      uint32_t                  m_window_us;
+      boost::mutex              m_mutex;
+      boost::condition_variable m_synced_cond;
+      uint64_t                  m_requested; // tickets handed to waiters
+      uint64_t                  m_synced;    // every ticket up to this one has been answered
+      uint64_t                  m_durable;   // every ticket up to this one is durable
+      std::string               m_error;     // the first failed fsync, see class doc
+      bool                      m_syncing;
+      uint64_t                  m_syncs;
+  };
+
+} // namespace ltl
+
+#endif
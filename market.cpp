@@ -1,6 +1,21 @@
 #include <ltl/market.hpp>
+#include <ltl/order_book.hpp>
+#include <ltl/order_pool.hpp>
+#include <ltl/market_writer.hpp>
+#include <ltl/order_journal.hpp>
+#include <ltl/note_links.hpp>
+#include <ltl/funds_ledger.hpp>
+#include <ltl/market_clock.hpp>
+#include <ltl/market_feed.hpp>
+#include <ltl/account.hpp>
 #include <ltl/persist.hpp>
+#include <ltl/crypto.hpp>
 #include <ltl/error.hpp>
+#include <scrypt/base64.hpp>
+#include <log/log.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
 
 namespace ltl {
 
@@ -17,102 +32,826 @@ market_order::market_order( const dbo::ptr<transaction>& _otrx ) {
     LTL_THROW( "First action is not a market offer" );
   }
   
-  end_date   = to_milliseconds(off->end); 
-  start_date = to_milliseconds(off->start); 
-  price      = off->offer_price;
-  num        = off->amount;
-  min_unit   = off->min_amount;
+  type         = off->order_type == "sell" ? sell : buy;
+  end_date     = to_milliseconds(off->end); 
+  start_date   = to_milliseconds(off->start); 
+  price        = off->offer_price;
+  num          = off->amount;
+  min_unit     = off->min_amount;
+  stop_price   = off->stop_price;
+  num_unfilled = num;
 
 
   dbo::ptr<account> sacnt = order_trx->session()->load<account>(std::string(off->asset_account));
   dbo::ptr<account> cacnt = order_trx->session()->load<account>(std::string(off->currency_account));
 
+  owner      = std::string(sacnt->owner()->get_id());
   stock_note = std::string(sacnt->type()->get_id());
   cur_note   = std::string(cacnt->type()->get_id());
+
+  funds_account = std::string( type == buy ? off->currency_account : off->asset_account );
 }
 
-market::market( dbo::Session& s )
-:m_session(s) {
+struct market::pending_queue : public order_queue {
+  pending_queue( order_pool& p ):pool(p){}
+  ~pending_queue() { clear_and_dispose( free_pending( pool ) ); }
+  struct free_pending {
+    free_pending( order_pool& p ):pool(p){}
+    void operator()( book_order* o )const { pool.free( o ); }
+    order_pool& pool;
+  };
+  order_pool& pool;
+};
+
+/**
+ *  Open orders by the id of their order_trx and by owner.  Owner lists
+ *  unlink themselves when an order is destroyed, the id map is kept in
+ *  step by close_order() and drop_order().
+ *
+ *  Owners are interned, orders carry the index of their owner's name.
+ */
+struct market::order_index {
+  typedef boost::intrusive::list< book_order, boost::intrusive::base_hook<owner_hook>,
+                                  boost::intrusive::constant_time_size<false> > owner_list;
+
+  uint32_t intern_owner( const std::string& owner ) {
+    boost::unordered_map<std::string, uint32_t>::iterator itr = owner_ids.find( owner );
+    if( itr != owner_ids.end() )
+      return itr->second;
+    owner_ids[owner] = owners.size();
+    owners.push_back( owner );
+    return owners.size() - 1;
+  }
+
+  boost::unordered_map<std::string, book_order*> by_id;
+  boost::unordered_map<uint32_t, owner_list>     by_owner;
+  boost::unordered_map<std::string, uint32_t>    owner_ids;
+  std::vector<std::string>                       owners;
+};
+
+market::market( dbo::Session& s, market_writer& w, uint32_t shard, uint32_t shards, order_journal* j,
+                const note_links* links, funds_ledger* ledger, const market_clock* clock, market_feed* feed )
+:m_session(s),m_writer(w),m_journal(j),m_links(links),m_ledger(ledger),
+ m_clock( clock ? clock : &market_clock::system() ),m_feed(feed),m_shard(shard),m_shards(shards),
+ m_pool( new order_pool() ),m_next_seq(0),
+ m_timers( m_clock->now() ),
+ m_pending( new pending_queue( *m_pool ) ),
+ m_index( new order_index() ) {
 }
 
 market::~market() {
+  for( book_map::iterator itr = m_books.begin(); itr != m_books.end(); ++itr )
+    delete itr->second;
+  delete m_pending;
+  delete m_index;
+  delete m_pool;
 }
 
 typedef dbo::collection<market_order::ptr> market_orders;
-void market::submit_order(  dbo::ptr<market_order> order ) {
+
+/**
+ *  Rebuilds the books from every order that can still trade, in the
+ *  order the rows were inserted.  This is the only time the market reads
+ *  market_order rows.  Orders are not matched against each other here,
+ *  the rows already reflect every trade made before the restart.
+ */
+void market::load_books() {
+  long long now = m_clock->now();
+
   dbo::Transaction dbtrx(m_session);
+  market_orders mos = m_session.find<market_order>()
+                      .where( "status = ? AND num_unfilled > 0 AND end_date >= ?" )
+                      .orderBy( "rowid" )
+                      .bind( int(market_order::open) )
+                      .bind( now );
+
+  std::vector<book_fill> fills;
+  uint32_t count = 0;
+  for( market_orders::const_iterator itr = mos.begin(); itr != mos.end(); ++itr ) {
+    if( shard_of( (*itr)->stock_note, (*itr)->cur_note, m_shards, m_links ) != m_shard )
+      continue;
+    order_entry e  = make_entry( *itr );
+    book_order* bo = make_order( e );
+    bo->seq = ++m_next_seq;
+    reserve_loaded( e );
+    place_order( bo, (*itr)->start_date, false, now, fills );
+    ++count;
+  }
+  dbtrx.commit();
+  slog( "loaded %1% open orders into %2% books", count, m_books.size() );
+}
+
+/**
+ *  Rebuilds the books from orders recovered from a journal, in arrival
+ *  order and without matching.
+ */
+void market::load_orders( const std::vector<order_entry>& orders ) {
+  long long now = m_clock->now();
+  std::vector<book_fill> fills;
+  for( uint32_t i = 0; i < orders.size(); ++i ) {
+    book_order* bo = make_order( orders[i] );
+    bo->seq = ++m_next_seq;
+    reserve_loaded( orders[i] );
+    place_order( bo, orders[i].start_date, false, now, fills );
+  }
+  slog( "recovered %1% open orders into %2% books", orders.size(), m_books.size() );
+}
+
+/**
+ *  Queues the database changes an earlier run journaled but may not have
+ *  committed and keeps them in this shard's journal until they are.
+ */
+void market::redo( const std::vector<std::string>& records ) {
+  if( m_journal ) m_journal->carry( records );
+  uint32_t count = 0;
+  for( uint32_t i = 0; i < records.size(); ++i ) {
+    journal_redo r;
+    if( !order_journal::decode_redo( records[i], r ) )
+      continue;
+    ++count;
+    switch( r.type ) {
+      case order_journal::trade:
+        m_writer.redo_trade( r.order_id, r.sell_order_id, r.num, r.price, r.timestamp, r.implied, r.bridge, r.key );
+        break;
+      case order_journal::fill:
+        m_writer.update_order( r.order_id, r.num, r.num ? market_order::open : market_order::filled );
+        break;
+      case order_journal::amend:
+        m_writer.amend_order( r.order_id, r.num, r.price );
+        break;
+      default: // cancel, expire
+        m_writer.update_order( r.order_id, r.num, market_order::cancelled );
+    }
+  }
+  commit_journal();
+  slog( "queued %1% journaled changes for the database", count );
+}
+
+static bool by_seq( const book_order* a, const book_order* b ) {
+  return a->seq < b->seq;
+}
+
+void market::write_snapshot() {
+  if( !m_journal )
+    return;
+  std::vector<const book_order*> orders;
+  for( book_map::const_iterator itr = m_books.begin(); itr != m_books.end(); ++itr ) {
+    const order_book& b = *itr->second;
+    for( order_book::bid_levels::const_iterator l = b.bids().begin(); l != b.bids().end(); ++l )
+      for( order_queue::const_iterator o = l->second.orders.begin(); o != l->second.orders.end(); ++o )
+        orders.push_back( &*o );
+    for( order_book::ask_levels::const_iterator l = b.asks().begin(); l != b.asks().end(); ++l )
+      for( order_queue::const_iterator o = l->second.orders.begin(); o != l->second.orders.end(); ++o )
+        orders.push_back( &*o );
+    for( order_book::buy_stop_levels::const_iterator l = b.buy_stops().begin(); l != b.buy_stops().end(); ++l )
+      for( order_queue::const_iterator o = l->second.begin(); o != l->second.end(); ++o )
+        orders.push_back( &*o );
+    for( order_book::sell_stop_levels::const_iterator l = b.sell_stops().begin(); l != b.sell_stops().end(); ++l )
+      for( order_queue::const_iterator o = l->second.begin(); o != l->second.end(); ++o )
+        orders.push_back( &*o );
+  }
+  for( pending_queue::const_iterator o = m_pending->begin(); o != m_pending->end(); ++o )
+    orders.push_back( &*o );
+
+  std::sort( orders.begin(), orders.end(), by_seq );
+
+  std::vector<order_entry> entries( orders.size() );
+  for( uint32_t i = 0; i < orders.size(); ++i )
+    entries[i] = to_entry( *orders[i] );
+  m_journal->write_snapshot( entries, m_writer.committed() );
+}
+
+void market::commit_journal() {
+  if( m_journal )
+    m_journal->commit( m_writer.queued(), m_writer.committed() );
+}
+
+/**
+ *  Interns note.  The first note of a linked group interns the whole
+ *  group so that implied matching can walk it by handle.
+ */
+uint32_t market::note_handle( const std::string& note ) {
+  uint32_t h = m_notes.find( note );
+  if( h )
+    return h;
+  if( !m_links || !m_links->is_linked( note ) ) {
+    h = m_notes.intern( note );
+    m_groups.resize( m_notes.size() + 1 );
+    return h;
+  }
+  const std::vector<std::string>& members = m_links->members( note );
+  std::vector<uint32_t> group;
+  for( uint32_t i = 0; i < members.size(); ++i )
+    group.push_back( m_notes.intern( members[i] ) );
+  m_groups.resize( m_notes.size() + 1 );
+  for( uint32_t i = 0; i < group.size(); ++i )
+    m_groups[group[i]] = group;
+  return m_notes.find( note );
+}
+
+order_book& market::get_book( const std::string& stock_note, const std::string& cur_note ) {
+  return get_book( make_pair_key( note_handle( stock_note ), note_handle( cur_note ) ) );
+}
+
+order_book& market::get_book( pair_key key ) {
+  order_book*& b = m_books[key];
+  if( !b ) {
+    const std::string& stock_note = m_notes.name( stock_of( key ) );
+    const std::string& cur_note   = m_notes.name( cur_of( key ) );
+    b = new order_book( stock_note, cur_note, m_pairs.size(), *m_pool, key );
+    if( m_feed )
+      b->set_channel( m_feed->get_channel( stock_note, cur_note ) );
+    m_pairs.push_back( b );
+  }
+  return *b;
+}
+
+order_book* market::find_book( const std::string& stock_note, const std::string& cur_note ) {
+  pair_key key = m_notes.find_pair( stock_note, cur_note );
+  return key ? find_book( key ) : 0;
+}
+
+order_book* market::find_book( pair_key key ) {
+  book_map::iterator itr = m_books.find( key );
+  return itr == m_books.end() ? 0 : itr->second;
+}
+
+uint32_t market::shard_of( const std::string& stock_note, const std::string& cur_note, uint32_t shards,
+                           const note_links* links ) {
+  if( links && links->is_linked( cur_note ) )
+    return boost::hash<std::string>()( links->group( cur_note ) ) % shards;
+  return boost::hash<pair_id>()( pair_id( stock_note, cur_note ) ) % shards;
+}
+
+order_entry market::make_entry( const market_order::ptr& o ) {
+  order_entry e;
+  e.id            = std::string( o->order_trx->get_id() );
+  e.owner         = o->owner;
+  e.stock_note    = o->stock_note;
+  e.cur_note      = o->cur_note;
+  e.type          = o->type;
+  e.price         = o->price;
+  e.num_unfilled  = o->num_unfilled;
+  e.min_unit      = o->min_unit;
+  e.stop_price    = o->stop_price;
+  e.funds_account = o->funds_account;
+  e.start_date    = o->start_date;
+  e.end_date      = o->end_date;
+  return e;
+}
+
+void market::seed_funds( funds_ledger& ledger, dbo::Session& s, const std::string& account_id ) {
+  if( account_id.empty() || ledger.has_funds( account_id ) )
+    return;
+  dbo::ptr<account> acnt = s.load<account>( account_id );
+  ledger.set_funds( account_id, acnt->get_unreserved_balance() );
+}
+
+void market::reserve_funds( funds_ledger& ledger, const market_order::ptr& o ) {
+  if( o->funds_account.empty() )
+    return;
+  seed_funds( ledger, *o->order_trx->session(), o->funds_account );
+  int64_t need = funds_ledger::required( o->type, o->price, o->num_unfilled );
+  int64_t have = ledger.available( o->funds_account );
+  if( have < need ) {
+    LTL_THROW( "Insufficient funds in account %1%, order needs %2% but only %3% is available", 
+               %o->funds_account %need %have );
+  }
+  ledger.reserve( std::string( o->order_trx->get_id() ), o->funds_account, o->type, o->price, o->num_unfilled );
+}
+
+void market::reserve_loaded( const order_entry& e ) {
+  if( m_ledger && e.funds_account.size() )
+    m_ledger->reserve( e.id, e.funds_account, e.type, e.price, e.num_unfilled );
+}
+
+/**
+ *  Allocates the resident record of e from the pool, resolving the
+ *  pair and owner to their handles.
+ */
+book_order* market::make_order( const order_entry& e ) {
+  book_order* bo   = m_pool->alloc( e.id );
+  bo->pair         = get_book( e.stock_note, e.cur_note ).pair();
+  bo->owner        = m_index->intern_owner( e.owner );
+  bo->type         = e.type;
+  bo->price        = e.price;
+  bo->num_unfilled = e.num_unfilled;
+  bo->min_unit     = e.min_unit;
+  bo->stop_price   = e.stop_price;
+  bo->end_date     = e.end_date;
+  return bo;
+}
+
+order_entry market::to_entry( const book_order& bo )const {
+  order_entry e;
+  e.id            = m_pool->id( bo.slot );
+  e.owner         = m_index->owners[bo.owner];
+  e.stock_note    = m_pairs[bo.pair]->stock_note();
+  e.cur_note      = m_pairs[bo.pair]->cur_note();
+  e.type          = bo.type;
+  e.price         = bo.price;
+  e.num_unfilled  = bo.num_unfilled;
+  e.min_unit      = bo.min_unit;
+  e.stop_price    = bo.stop_price;
+  e.funds_account = m_ledger ? m_ledger->account_of( e.id ) : std::string();
+  e.start_date    = bo.state == book_order::pending ? bo.when : 0; // 0 once active
+  e.end_date      = bo.end_date;
+  return e;
+}
+
+bool market::in_auction( const order_book& book )const {
+  return m_auctions.find( book.key() ) != m_auctions.end();
+}
+
+/**
+ *  Takes ownership of bo.  Before its start_date the order waits in the
+ *  pending queue, afterwards it is activated.
+ */
+void market::place_order( book_order* bo, long long start_date, bool match, long long now,
+                          std::vector<book_fill>& fills ) {
+  if( now < start_date && now <= bo->end_date ) {
+    m_pending->push_back( *bo );
+    m_timers.schedule( *bo, start_date );
+    index_order( bo );
+    return;
+  }
+  activate( bo, match, now, fills );
+}
+
+/**
+ *  A stop order that has not been triggered yet waits in the trigger
+ *  table of its book.  Anything else is matched (if match is set and the
+ *  pair trades continuously) and any remainder rests in the book until
+ *  its end_date.
+ */
+void market::activate( book_order* bo, bool match, long long now, std::vector<book_fill>& fills ) {
+  if( now > bo->end_date ) {
+    const std::string& id = m_pool->id( bo->slot );
+    m_writer.update_order( id, bo->num_unfilled, market_order::cancelled );
+    if( m_journal ) m_journal->log_expire( id, bo->num_unfilled );
+    if( m_ledger ) m_ledger->release( id );
+    m_index->by_id.erase( id );
+    m_pool->free( bo );
+    return;
+  }
+
+  order_book& book = *m_pairs[bo->pair];
+  if( bo->stop_price ) {
+    if( !book.stop_triggered( *bo ) ) {
+      book.arm( bo );
+      m_timers.schedule( *bo, bo->end_date + 1 );
+      index_order( bo );
+      return;
+    }
+    trigger( *bo );
+  }
+  if( !book.accepts( bo->price ) ) {
+    // the tick range was narrowed while the order waited, it is closed as submit_order would
+    const std::string& id = m_pool->id( bo->slot );
+    wlog( "order %1% at %2% is outside the tick range of its pair", id, bo->price );
+    m_writer.update_order( id, bo->num_unfilled, market_order::cancelled );
+    if( m_journal ) m_journal->log_cancel( id, bo->num_unfilled );
+    if( m_ledger ) m_ledger->release( id );
+    m_index->by_id.erase( id );
+    m_pool->free( bo );
+    return;
+  }
+
+  if( match && !in_auction( book ) )
+    this->match( book, *bo, now, fills );
+
+  if( bo->num_unfilled == 0 ) {
+    m_pool->free( bo );
+    return;
+  }
+  book.insert( bo );
+  m_timers.schedule( *bo, bo->end_date + 1 );
+  index_order( bo );
+}
+
+/**
+ *  Turns a stop order into a limit order, the journal has to know so
+ *  that it is not held back again after a restart.
+ */
+void market::trigger( book_order& bo ) {
+  if( m_journal ) m_journal->log_trigger( m_pool->id( bo.slot ) );
+  bo.stop_price = 0;
+}
+
+/**
+ *  Releases every stop order that the trades since the last call have
+ *  reached.  Trades made by released orders may reach further stops,
+ *  which are released in turn.
+ */
+void market::release_stops( long long now, std::vector<book_fill>& fills ) {
+  while( !m_touched.empty() ) {
+    order_book* book = m_touched.back();
+    m_touched.pop_back();
+    while( book_order* bo = book->pop_triggered() ) {
+      trigger( *bo );
+      activate( bo, true, now, fills );
+    }
+  }
+}
+
+/**
+ *  The best price for an order of one pair through another note of the
+ *  group of its currency: the leg book trades the stock for the other
+ *  note, the bridge book trades the other note for the currency.
+ */
+struct market::implied_route {
+  order_book* leg;
+  order_book* bridge;
+  long long   price;  // leg price * bridge price
+};
+
+/**
+ *  Finds the best implied price that o accepts.  Only the best level of
+ *  each book is considered, so this is called again after every fill.
+ */
+bool market::best_implied( const order_book& book, const book_order& o, implied_route& r ) {
+  const std::vector<uint32_t>& notes = m_groups[book.cur()];
+  const std::vector<uint32_t>& stock = m_groups[book.stock()];
+  if( notes.empty() || ( stock.size() && stock[0] == notes[0] ) )
+    return false;
+
+  bool buy   = o.type == market_order::buy;
+  bool found = false;
+  for( uint32_t i = 0; i < notes.size(); ++i ) {
+    if( notes[i] == book.cur() )
+      continue;
+    order_book* leg    = find_book( make_pair_key( book.stock(), notes[i] ) );
+    order_book* bridge = find_book( make_pair_key( notes[i], book.cur() ) );
+    if( !leg || !bridge || in_auction( *leg ) || in_auction( *bridge ) )
+      continue;
+
+    long long price;
+    if( buy ) {
+      if( leg->asks().empty() || bridge->asks().empty() ) continue;
+      price = leg->asks().begin()->first * bridge->asks().begin()->first;
+      if( price > o.price ) continue;
+    } else {
+      if( leg->bids().empty() || bridge->bids().empty() ) continue;
+      price = leg->bids().begin()->first * bridge->bids().begin()->first;
+      if( price < o.price ) continue;
+    }
+    if( !found || ( buy ? price < r.price : price > r.price ) ) {
+      found    = true;
+      r.leg    = leg;
+      r.bridge = bridge;
+      r.price  = price;
+    }
+  }
+  return found;
+}
+
+/**
+ *  Trades o against the oldest order at the best price of both books of
+ *  r.  The quantity is sized so that the bridge delivers exactly the
+ *  notes the leg needs, if that violates any min_unit nothing trades.
+ *
+ *  @return false if nothing could be traded
+ */
+bool market::fill_implied( const implied_route& r, book_order& o, long long now, std::vector<book_fill>& fills ) {
+  int         side = o.type == market_order::buy ? market_order::sell : market_order::buy;
+  book_order* lr   = r.leg->front( side );
+  book_order* br   = r.bridge->front( side );
+  if( lr->price <= 0 )
+    return false;
+
+  long long q  = (std::min)( o.num_unfilled, lr->num_unfilled );
+  q            = (std::min)( q, br->num_unfilled / lr->price );
+  long long qb = q * lr->price;
+  if( q <= 0 ||
+      ( q < o.min_unit && q != o.num_unfilled ) ||
+      ( q < lr->min_unit && q != lr->num_unfilled ) ||
+      ( qb < br->min_unit && qb != br->num_unfilled ) )
+    return false;
+
+  r.leg->fill( *lr, o, q, now, fills );
+
+  // o trades the linked note on the bridge without changing its own unfilled quantity
+  book_order conv;
+  conv.slot         = o.slot;
+  conv.type         = o.type;
+  conv.num_unfilled = o.num_unfilled + qb;
+  r.bridge->fill( *br, conv, qb, now, fills );
+
+  // o paid the implied price for q, record_fills() must not count either leg for it
+  fills[fills.size()-2].implied = o.type;
+  fills[fills.size()-1].implied = o.type;
+  fills[fills.size()-1].bridge  = true;
+  if( m_ledger ) m_ledger->fill( m_pool->id( o.slot ), q, r.price );
+
+  m_touched.push_back( r.leg );
+  m_touched.push_back( r.bridge );
+  return true;
+}
+
+/**
+ *  Crosses o against its own book and, where it is better, against the
+ *  implied liquidity of the linked notes of its currency.
+ */
+void market::match( order_book& book, book_order& o, long long now, std::vector<book_fill>& fills ) {
+  m_touched.push_back( &book );
+  implied_route r;
+  while( o.num_unfilled > 0 && best_implied( book, o, r ) ) {
+    // the pair's own levels up to the implied price go first
+    book.match( o, r.price, now, fills );
+    if( o.num_unfilled == 0 || !fill_implied( r, o, now, fills ) )
+      break;
+  }
+  if( o.num_unfilled > 0 )
+    book.match( o, now, fills );
+}
+
+void market::index_order( book_order* bo ) {
+  if( bo->owner_hook::is_linked() )
+    return;
+  m_index->by_id[m_pool->id( bo->slot )] = bo;
+  m_index->by_owner[bo->owner].push_back( *bo );
+}
+
+/**
+ *  Takes bo out of whichever book or queue holds it and destroys it.
+ */
+void market::drop_order( book_order* bo ) {
+  if( m_ledger ) m_ledger->release( m_pool->id( bo->slot ) );
+  m_index->by_id.erase( m_pool->id( bo->slot ) );
+  if( bo->state != book_order::pending ) {
+    m_pairs[bo->pair]->remove( *bo );
+  } else {
+    m_pending->erase( m_pending->iterator_to(*bo) );
+    m_pool->free( bo );
+  }
+}
+
+/**
+ *  Fires every timer due at now.  Pending orders become active and are
+ *  matched, orders past their end_date leave the book.
+ */
+void market::run_timers( long long now, std::vector<book_fill>& fills ) {
+  while( timer_entry* e = m_timers.pop_due( now ) ) {
+    book_order* bo = static_cast<book_order*>(e);
+    if( bo->state != book_order::pending ) {
+      // there is no expired status, the row is closed as cancel_order closes it
+      const std::string& id = m_pool->id( bo->slot );
+      m_writer.update_order( id, bo->num_unfilled, market_order::cancelled );
+      if( m_journal ) m_journal->log_expire( id, bo->num_unfilled );
+      drop_order( bo );
+    } else {
+      m_pending->erase( m_pending->iterator_to(*bo) );
+      activate( bo, true, now, fills );
+      release_stops( now, fills );
+    }
+  }
+}
+
+void market::submit_order(  dbo::ptr<market_order> order ) {
   if( !order->order_trx ) {
     LTL_THROW( "No order transaction specified." );
   }
   /// TODO: Verify that order_trx is valid and signed by host.
-  /// TODO: Verify that sufficient funds exist in payment account
+  if( m_ledger )
+    reserve_funds( *m_ledger, order );
 
+  // only the new row is written here, the results of matching go through m_writer
+  dbo::Transaction dbtrx(m_session);
   dbo::ptr<market_order> o = m_session.add(order);
+  dbtrx.commit();
 
-  market_order::order_type counter_type = o->type == market_order::buy ? market_order::sell : market_order::buy;
-
-  // select all sell orders where price <= o->price
-  if( o->type == market_order::buy ) {  
-      long long now = to_milliseconds( to_ptime( system_clock::now() ) );
-      if( now < o->start_date || now > o->end_date ) {
-         // Not time to process this trx yet
-      } else {
-         market_orders mos = m_session.find<market_order>()
-                             .where( "type = ? AND price <= ? AND num_unfilled >= ? AND start_date < ? AND end_date < ? " )
-                             .orderBy( "price ASC" )
-                             .bind( market_order::sell )
-                             .bind( o->price )
-                             .bind( o->min_unit )
-                             .bind( now )
-                             .bind( now );
-         
-         // keep the results around..
-         std::vector<market_order::ptr> sell_orders;
-         market_orders::iterator itr = mos.begin();
-         while( itr != mos.end() ) {
-           sell_orders.push_back(*itr);
-         }
-         
-         for( uint32_t i = 0; i < sell_orders.size(); ++i ) {
-           // we can fill part of our order...
-           market_trade::ptr mt( new market_trade( o, sell_orders[i] ) );
-           mt.modify()->num       = (std::min)(o->num_unfilled, sell_orders[i]->num_unfilled );
-           mt.modify()->price     = sell_orders[i]->price;
-           mt.modify()->timestamp = now;
-
-           o.modify()->num_unfilled              -= mt->num;
-           sell_orders[i].modify()->num_unfilled -= mt->num;
-
-           m_session.add(mt);
-
-           update_fill_trx(sell_orders[i]);
-
-           if( o->num_unfilled == 0 ) {
-              update_fill_trx(o);
-              close_order( o );
-              i = sell_orders.size(); // we are done
-           }
-           if( sell_orders[i]->num_unfilled == 0 ) {
-              close_order( sell_orders[i] );
-           }
-         }
-         update_fill_trx(o);
-      }
-  } else if ( o->type == market_order::sell ) {
+  submit_order( make_entry( o ) );
+}
 
+void market::submit_order( const order_entry& e ) {
+  long long now = m_clock->now();
 
+  std::vector<book_fill> fills;
+  run_timers( now, fills );
+  if( !get_book( e.stock_note, e.cur_note ).accepts( e.price ) ) {
+    wlog( "order %1% at %2% is outside the tick range of its pair", e.id, e.price );
+    m_writer.update_order( e.id, e.num_unfilled, market_order::cancelled );
+    if( m_journal ) m_journal->log_cancel( e.id, e.num_unfilled );
+    if( m_ledger ) m_ledger->release( e.id );
+    record_fills( fills, now );
+    commit_journal();
+    return;
   }
+  if( m_journal ) m_journal->log_new( e );
 
-  dbtrx.commit();
+  book_order* bo = make_order( e );
+  bo->seq = ++m_next_seq;
+  place_order( bo, e.start_date, true, now, fills );
+  release_stops( now, fills );
+  record_fills( fills, now );
+  commit_journal();
 }
 
-void market::update_fill_trx( const market_order::ptr& mo ) {
-  
+bool market::cancel_order( const std::string& oid ) {
+  boost::unordered_map<std::string, book_order*>::iterator itr = m_index->by_id.find( oid );
+  if( itr == m_index->by_id.end() )
+    return false;
+
+  m_writer.update_order( oid, itr->second->num_unfilled, market_order::cancelled );
+  if( m_journal ) m_journal->log_cancel( oid, itr->second->num_unfilled );
+  drop_order( itr->second );
+  commit_journal();
+  return true;
 }
 
-void market::close_order( const market_order::ptr& mo ) {
-  
+bool market::amend_order( const std::string& oid, long long num_unfilled, long long price ) {
+  if( num_unfilled <= 0 || price <= 0 ) {
+    LTL_THROW( "Invalid amend of order %1%, use cancel to remove it", %oid );
+  }
 
+  // timers can fill, expire or activate the order, it is looked up after they ran
+  long long now = m_clock->now();
+  std::vector<book_fill> fills;
+  run_timers( now, fills );
+  if( fills.size() ) {
+    record_fills( fills, now );
+    fills.clear();
+  }
+  commit_journal();
+
+  boost::unordered_map<std::string, book_order*>::iterator itr = m_index->by_id.find( oid );
+  if( itr == m_index->by_id.end() )
+    return false;
+  book_order* bo = itr->second;
+  bool requeue = price != bo->price && bo->state == book_order::resting;
+  if( !m_pairs[bo->pair]->accepts( price ) ) {
+    LTL_THROW( "Amend of order %1% to %2% is outside the tick range of its pair", %oid %price );
+  }
+  if( !requeue && num_unfilled > bo->num_unfilled ) {
+    LTL_THROW( "Amend of order %1% may only reduce its quantity unless it changes the price", %oid );
+  }
+  if( m_ledger && !m_ledger->amend( oid, price, num_unfilled ) ) {
+    LTL_THROW( "Insufficient funds to amend order %1%", %oid );
+  }
+
+  if( m_journal ) m_journal->log_amend( oid, num_unfilled, price );
+  m_writer.amend_order( oid, num_unfilled, price );
+
+  if( !requeue ) {
+    if( bo->state == book_order::pending )
+      bo->num_unfilled = num_unfilled;
+    else
+      m_pairs[bo->pair]->reduce( *bo, num_unfilled );
+    bo->price = price;  // only differs for orders that are not in a level yet
+  } else {
+    m_pairs[bo->pair]->unlink( *bo );
+    bo->price        = price;
+    bo->num_unfilled = num_unfilled;
+    bo->seq          = ++m_next_seq;
+    activate( bo, true, now, fills );
+    release_stops( now, fills );
+  }
+  record_fills( fills, now );
+  commit_journal();
+  return true;
+}
+
+uint32_t market::cancel_orders( const std::string& owner ) {
+  boost::unordered_map<std::string, uint32_t>::iterator oid = m_index->owner_ids.find( owner );
+  if( oid == m_index->owner_ids.end() )
+    return 0;
+  boost::unordered_map<uint32_t, order_index::owner_list>::iterator itr = m_index->by_owner.find( oid->second );
+  if( itr == m_index->by_owner.end() )
+    return 0;
+
+  uint32_t count = 0;
+  order_index::owner_list& ol = itr->second;
+  while( !ol.empty() ) {
+    book_order&        bo = ol.front();
+    const std::string& id = m_pool->id( bo.slot );
+    m_writer.update_order( id, bo.num_unfilled, market_order::cancelled );
+    if( m_journal ) m_journal->log_cancel( id, bo.num_unfilled );
+    drop_order( &bo ); // unlinks itself from ol
+    ++count;
+  }
+  m_index->by_owner.erase( itr );
+  commit_journal();
+  return count;
+}
+
+std::string market::order_owner( const std::string& oid )const {
+  boost::unordered_map<std::string, book_order*>::const_iterator itr = m_index->by_id.find( oid );
+  return itr == m_index->by_id.end() ? std::string() : m_index->owners[itr->second->owner];
+}
+
+void market::set_call_auction( const std::string& stock_note, const std::string& cur_note, uint64_t interval_ms ) {
+  order_book& book = get_book( stock_note, cur_note );
+  long long   now  = m_clock->now();
+  if( interval_ms == 0 ) {
+    if( m_auctions.erase( book.key() ) ) 
+      clear_auction( book, now );
+    commit_journal();
+    return;
+  }
+  auction_schedule& as = m_auctions[book.key()];
+  as.interval = interval_ms;
+  as.next     = now + interval_ms;
+}
+
+void market::set_tick_range( const std::string& stock_note, const std::string& cur_note, long long lo, long long hi ) {
+  get_book( stock_note, cur_note ).set_tick_range( lo, hi );
+}
+
+void market::tick( long long now ) {
+  std::vector<book_fill> fills;
+  run_timers( now, fills );
+  record_fills( fills, now );
+
+  for( auction_map::iterator itr = m_auctions.begin(); itr != m_auctions.end(); ++itr ) {
+    if( itr->second.next > now ) 
+      continue;
+    clear_auction( get_book( itr->first ), now );
+    // skip intervals that were missed rather than running them back to back
+    while( itr->second.next <= now )
+      itr->second.next += itr->second.interval;
+  }
+  commit_journal();
+
+  if( m_journal && m_journal->events_since_snapshot() >= snapshot_interval )
+    write_snapshot();
+}
+
+uint64_t market::get_depth( const std::string& stock_note, const std::string& cur_note, uint32_t max_levels,
+                            std::vector<depth_level>& bids, std::vector<depth_level>& asks ) {
+  order_book* b = find_book( stock_note, cur_note );
+  if( !b ) return 0;
+  return b->get_depth( max_levels, bids, asks );
+}
+
+bool market::get_depth_deltas( const std::string& stock_note, const std::string& cur_note, 
+                               uint64_t since_seq, std::vector<depth_delta>& deltas ) {
+  order_book* b = find_book( stock_note, cur_note );
+  if( !b ) return since_seq == 0;
+  return b->get_depth_deltas( since_seq, deltas );
+}
+
+tape_stats market::get_stats( const std::string& stock_note, const std::string& cur_note, long long window_ms,
+                              uint32_t resolution_ms, uint32_t max_candles, std::vector<candle>& candles ) {
+  order_book* b = find_book( stock_note, cur_note );
+  if( !b ) return tape_stats();
+  b->tape().get_candles( resolution_ms, max_candles, candles );
+  return b->tape().rolling( m_clock->now(), window_ms );
+}
+
+/**
+ *  Clears the book at one price and records every resulting trade.
+ */
+void market::clear_auction( order_book& book, long long now ) {
+  std::vector<book_fill> fills;
+  long long price = book.clear_auction( now, fills );
+  if( !price )
+    return;
+  slog( "call auction %1%/%2% cleared %3% trades at %4%", book.stock_note(), book.cur_note(), fills.size(), price );
+  m_touched.push_back( &book );
+  release_stops( now, fills );
+  record_fills( fills, now );
+}
+
+/**
+ *  Queues the trades produced by matching and the new unfilled
+ *  quantities of every order involved for the writer.
+ */
+void market::record_fills( const std::vector<book_fill>& fills, long long now ) {
+  for( uint32_t i = 0; i < fills.size(); ++i ) {
+    const book_fill&   f       = fills[i];
+    const std::string& buy_id  = m_pool->id( f.buy );
+    const std::string& sell_id = m_pool->id( f.sell );
+    std::string key;
+    if( m_journal ) key = m_journal->log_trade( buy_id, sell_id, f.num, f.price, now, f.implied, f.bridge );
+    m_writer.add_trade( buy_id, sell_id, f.num, f.price, now, f.implied, f.bridge, key );
+    if( m_ledger ) {
+      if( f.implied != market_order::buy )  m_ledger->fill( buy_id, f.num, f.price );
+      if( f.implied != market_order::sell ) m_ledger->fill( sell_id, f.num, f.price );
+    }
+    if( m_journal ) {
+      m_journal->log_fill( buy_id, f.buy_unfilled );
+      m_journal->log_fill( sell_id, f.sell_unfilled );
+    }
+
+    if( f.buy_unfilled == 0 ) {
+      close_order( buy_id );
+    } else {
+      m_writer.update_order( buy_id, f.buy_unfilled, market_order::open );
+    }
+    if( f.sell_unfilled == 0 ) {
+      close_order( sell_id );
+    } else {
+      m_writer.update_order( sell_id, f.sell_unfilled, market_order::open );
+    }
+  }
+  // the fills no longer need the ids of the orders they freed
+  m_pool->reclaim();
+}
+
+void market::close_order( const std::string& order_id ) {
+  if( m_ledger ) m_ledger->release( order_id );
+  m_index->by_id.erase( order_id );
+  m_writer.update_order( order_id, 0, market_order::filled );
 }
 
 market_trade::market_trade( const market_order::ptr& b, const market_order::ptr& s )
@@ -120,4 +859,18 @@ market_trade::market_trade( const market_order::ptr& b, const market_order::ptr&
 
 }
 
+order_amend::order_amend( const market_order::ptr& o, long long n, long long p, long long d,
+                          const signature& sig )
+:order(o),num_unfilled(n),price(p),date(d),owner_sig( scrypt::to_base64( sig ) ) {
+}
+
+sha1 order_amend::digest( const std::string& order_id, long long num_unfilled, long long price, long long date ) {
+  scrypt::sha1_encoder enc;
+  enc.write( order_id.c_str(), order_id.size() );
+  enc << num_unfilled;
+  enc << price;
+  enc << date;
+  return enc.result();
+}
+
 } // namespace ltl
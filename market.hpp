@@ -1,13 +1,34 @@
 #ifndef _LTL_MARKET_HPP_
 #define _LTL_MARKET_HPP_
 #include <ltl/transaction.hpp>
+#include <ltl/timer_wheel.hpp>
+#include <ltl/note_table.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
 
 namespace ltl {
 
   class market_trade;
+  class order_amend;
   class transaction;
+  class order_book;
+  class market_writer;
+  class order_journal;
+  class note_links;
+  class funds_ledger;
+  class market_clock;
+  class market_feed;
+  struct book_order;
+  struct order_entry;
+  class order_pool;
+  struct book_fill;
+  struct depth_level;
+  struct depth_delta;
+  struct tape_stats;
+  struct candle;
 
   typedef dbo::collection<dbo::ptr<market_trade> > market_trades;
+  typedef dbo::collection<dbo::ptr<order_amend> >  order_amends;
 
   class market_order : public dbo::Dbo<market_order>, public dbo::ptr<market_order> {
     public:
@@ -15,15 +36,22 @@ namespace ltl {
         buy  = 0x01,
         sell = 0x02
       };
+      enum order_status {
+        open      = 0,
+        filled    = 1,
+        cancelled = 2
+      };
       market_order( const dbo::ptr<transaction>& order_trx );
-      market_order(){}
+      market_order():status(open),stop_price(0){}
 
       template<typename Action>
       void persist( Action& a );
 
       dbo::ptr<transaction> order_trx; // primary key, source of authorization for this order
-      dbo::ptr<transaction> fill_trx;  // the transaction that holds trades... will change after every trade.
+      dbo::ptr<transaction> fill_trx;  // the latest transaction settling its fills, see market_writer
       int                   type;
+      int                   status;
+      std::string           owner;     // identity that owns the stock and currency accounts
       std::string           stock_note; 
       std::string           cur_note; 
       long long             num; 
@@ -31,11 +59,14 @@ namespace ltl {
       long long             start_date;
       long long             end_date;
       long long             min_unit;
+      long long             stop_price;   // 0 for a limit order, see market
+      std::string           funds_account; // pays for the order, currency for a buy and stock for a sell
 
       long long             num_unfilled; // num - sum(trades.num)
 
       market_trades         buy_trades;
       market_trades         sell_trades;
+      order_amends          amends;
   };
 
   class market_trade : public dbo::Dbo<market_trade>, public dbo::ptr<market_trade> {
@@ -51,14 +82,122 @@ namespace ltl {
       long long            num;
       long long            price;
       long long            timestamp;
+      std::string          journal_key; // see order_journal::log_trade
+  };
+
+  /**
+   *  A change to an open order signed by its owner: from date on the
+   *  order has num_unfilled left at price.  Only digest() is signed, the
+   *  order_trx stays as it is and needs no new signatures.
+   */
+  class order_amend : public dbo::Dbo<order_amend>, public dbo::ptr<order_amend> {
+    public:
+      order_amend( const market_order::ptr& o, long long num_unfilled, long long price, long long date,
+                   const signature& owner_sig );
+      order_amend():num_unfilled(0),price(0),date(0){}
+
+      template<typename Action>
+      void persist( Action& a );
+
+      static sha1 digest( const std::string& order_id, long long num_unfilled, long long price, long long date );
+
+      market_order::ptr    order;
+      long long            num_unfilled;
+      long long            price;
+      long long            date;
+      std::string          owner_sig;   // base64
   };
   
 
+  /**
+   *  Matches orders against a resident order_book per (stock_note, cur_note)
+   *  pair.  The books are loaded from the open market_order rows once when
+   *  the market is created, after that matching never queries the database.
+   *  New orders are added to the session, every later change to the
+   *  market_order rows and all market_trade rows are handed to a
+   *  market_writer and committed in the background.
+   *
+   *  A pair trades continuously unless it has been put into call auction
+   *  mode, in which case orders only rest in the book until tick() clears
+   *  the whole book at one price once per interval.
+   *
+   *  Orders are held back until their start_date and taken out of the
+   *  book after their end_date by a timer wheel, so the books only ever
+   *  contain orders that may trade.  Due timers run at the start of
+   *  every submit_order() and tick().
+   *
+   *  An order with a stop_price is held in its book's trigger table
+   *  until a trade of the pair reaches the stop price, at or above it
+   *  for a buy and at or below it for a sell.  Stops reached by a
+   *  matching pass are released in the same pass, from then on the order
+   *  is a limit order at its price.
+   *
+   *  If the currency of a pair is linked to other notes (see note_links)
+   *  an order also trades through implied liquidity: buying stock with
+   *  note A through the (stock, B) book and the (B, A) book, at the
+   *  product of their prices.  Both legs are filled together in the
+   *  same pass, the pair's own book keeps priority at equal prices.
+   *  Every pair of a group must therefore be matched by one market,
+   *  shard_of() places pairs by the group of their currency.
+   *
+   *  With a funds_ledger every open order holds a reservation of its
+   *  funds_account which fills consume and cancels and expiry release,
+   *  see reserve_funds().
+   */
   class market {
     public:
-      market( dbo::Session& s ); 
+      /**
+       *  A market may hold only the pairs of one shard, shard_of() decides
+       *  which.  The session is only used by load_books() and by
+       *  submit_order( dbo::ptr<market_order> ), so a market that is fed
+       *  through submit_order( const order_entry& ) may run on any thread.
+       *
+       *  If a journal is given every change to the open orders is logged
+       *  to it and tick() writes a snapshot every snapshot_interval
+       *  records.  The books start empty, fill them with load_books() or
+       *  load_orders().
+       *
+       *  links, if given, must outlive the market and must have been used
+       *  to assign the pairs to shards.
+       *
+       *  ledger, if given, must outlive the market.  Loaded orders are
+       *  reserved without checking, they were accepted before.
+       *
+       *  Every time the market reads comes from clock, the wall clock
+       *  unless another one is given.  The timestamps of trades and the
+       *  times passed to tick() must be on the same clock.
+       *
+       *  feed, if given, must outlive the market and receives every depth
+       *  change of its books.
+       */
+      market( dbo::Session& s, market_writer& w, uint32_t shard = 0, uint32_t shards = 1,
+              order_journal* j = 0, const note_links* links = 0, funds_ledger* ledger = 0,
+              const market_clock* clock = 0, market_feed* feed = 0 ); 
       ~market();
 
+      enum { snapshot_interval = 100000 };
+
+      /**
+       *  Loads the open orders of this shard from the market_order rows.
+       */
+      void load_books();
+
+      /**
+       *  Loads orders recovered from a journal.
+       */
+      void load_orders( const std::vector<order_entry>& orders );
+
+      /**
+       *  Queues the database changes recovered from a journal, see
+       *  order_journal::replay.
+       */
+      void redo( const std::vector<std::string>& records );
+
+      /**
+       *  Writes every open order to the journal snapshot.
+       */
+      void write_snapshot();
+
       /**
        *  Adds the market order to the session, checks to
        *  see if it allows any orders to be filled. Fills
@@ -67,11 +206,177 @@ namespace ltl {
        */
       //void submit_order( const market_order::ptr& order );
       void submit_order( dbo::ptr<market_order> order );
-      void close_order( const market_order::ptr& order );
-      void update_fill_trx( const market_order::ptr& order );
+      void close_order( const std::string& order_id );
+
+      /**
+       *  Matches an order whose market_order row has already been added.
+       */
+      void submit_order( const order_entry& order );
+
+      /**
+       *  Copies the order into an order_entry, must be called on the
+       *  thread that owns the session of o.
+       */
+      static order_entry make_entry( const market_order::ptr& o );
+
+      /**
+       *  Reserves what o needs of its funds_account, reading the balance
+       *  of the account only if the ledger does not know it yet.  Must be
+       *  called on the thread that owns the session of o and before the
+       *  order is matched.
+       *
+       *  @throw if the account does not have that much available
+       */
+      static void reserve_funds( funds_ledger& ledger, const market_order::ptr& o );
+
+      /**
+       *  Tells the ledger the funds of account if it does not know them,
+       *  see account::get_unreserved_balance().
+       */
+      static void seed_funds( funds_ledger& ledger, dbo::Session& s, const std::string& account );
+
+      /**
+       *  Pairs quoted in a linked note are placed by the group of the
+       *  note so that implied matching finds every book of the group.
+       */
+      static uint32_t shard_of( const std::string& stock_note, const std::string& cur_note, uint32_t shards,
+                                const note_links* links = 0 );
+
+      /**
+       *  Removes the open order whose order_trx has the given id from the
+       *  book, or from the orders waiting for their start_date, and marks
+       *  it cancelled.  Both lookups are hash/list based, the book is
+       *  never searched.
+       *
+       *  @return false if no such order is open
+       */
+      bool     cancel_order( const std::string& order_id );
+
+      /**
+       *  Changes the open order to num_unfilled at price.  With the same
+       *  price the quantity may only go down and the order keeps its
+       *  place in the queue.  A new price moves the order to the back of
+       *  the queue at that price, where it is matched again like a new
+       *  order.  Orders waiting for their start_date or their stop price
+       *  keep waiting.
+       *
+       *  @return false if no such order is open
+       *  @throw if the amend is invalid or the funds ledger refuses it
+       */
+      bool     amend_order( const std::string& order_id, long long num_unfilled, long long price );
+
+      /**
+       *  Cancels every open order owned by the identity.
+       *  @return the number of orders cancelled
+       */
+      uint32_t cancel_orders( const std::string& owner );
+
+      /**
+       *  @return the owner of the open order, or an empty string if there
+       *          is no such open order.
+       */
+      std::string order_owner( const std::string& order_id )const;
+
+      /**
+       *  Collects orders for the pair and clears them every interval_ms
+       *  instead of matching each one on arrival.  An interval of 0 clears
+       *  whatever has been collected and returns the pair to continuous
+       *  matching.
+       */
+      void set_call_auction( const std::string& stock_note, const std::string& cur_note, uint64_t interval_ms );
+
+      /**
+       *  Bounds the prices of the pair to lo .. hi, see
+       *  order_book::set_tick_range.  Later orders priced outside the
+       *  bound are closed as cancelled without trading, as are waiting
+       *  and stop orders outside it when they activate.  Amends to such
+       *  a price are refused.
+       */
+      void set_tick_range( const std::string& stock_note, const std::string& cur_note, long long lo, long long hi );
+
+      /**
+       *  Activates and expires orders whose start/end date has passed and
+       *  runs every call auction that is due at now (utc ms).  Expected to
+       *  be called periodically by the owner of the market.
+       */
+      void tick( long long now );
+
+      /**
+       *  Aggregated depth of the pair, see order_book::get_depth.  Both
+       *  are served from the resident book and never touch the database.
+       */
+      uint64_t get_depth( const std::string& stock_note, const std::string& cur_note, uint32_t max_levels,
+                          std::vector<depth_level>& bids, std::vector<depth_level>& asks );
+      bool     get_depth_deltas( const std::string& stock_note, const std::string& cur_note, 
+                                 uint64_t since_seq, std::vector<depth_delta>& deltas );
+
+      /**
+       *  Volume and vwap of the pair's trades over the last window_ms and
+       *  up to max_candles of its most recent candles at resolution_ms,
+       *  served from the book's trade_tape.
+       */
+      tape_stats get_stats( const std::string& stock_note, const std::string& cur_note, long long window_ms,
+                            uint32_t resolution_ms, uint32_t max_candles, std::vector<candle>& candles );
 
      private:
-      dbo::Session& m_session;
+      typedef std::pair<std::string,std::string>          pair_id;
+      typedef boost::unordered_map<pair_key, order_book*> book_map;
+      typedef std::vector<order_book*>                    book_list;
+      typedef std::vector< std::vector<uint32_t> >        note_groups;
+
+      struct auction_schedule {
+        uint64_t  interval;
+        long long next;
+      };
+      typedef std::map<pair_key, auction_schedule> auction_map;
+      struct pending_queue;
+      struct order_index;
+      struct implied_route;
+
+      void        commit_journal();
+      uint32_t    note_handle( const std::string& note );
+      order_book& get_book( const std::string& stock_note, const std::string& cur_note );
+      order_book& get_book( pair_key key );
+      order_book* find_book( const std::string& stock_note, const std::string& cur_note );
+      order_book* find_book( pair_key key );
+      book_order* make_order( const order_entry& e );
+      order_entry to_entry( const book_order& bo )const;
+      bool        in_auction( const order_book& book )const;
+      void        place_order( book_order* bo, long long start_date, bool match, long long now,
+                               std::vector<book_fill>& fills );
+      void        activate( book_order* bo, bool match, long long now, std::vector<book_fill>& fills );
+      void        match( order_book& book, book_order& bo, long long now, std::vector<book_fill>& fills );
+      bool        best_implied( const order_book& book, const book_order& bo, implied_route& r );
+      bool        fill_implied( const implied_route& r, book_order& bo, long long now, std::vector<book_fill>& fills );
+      void        trigger( book_order& bo );
+      void        release_stops( long long now, std::vector<book_fill>& fills );
+      void        run_timers( long long now, std::vector<book_fill>& fills );
+      void        reserve_loaded( const order_entry& e );
+      void        index_order( book_order* bo );
+      void        drop_order( book_order* bo );
+      void        clear_auction( order_book& book, long long now );
+      void        record_fills( const std::vector<book_fill>& fills, long long now );
+
+      dbo::Session&       m_session;
+      market_writer&      m_writer;
+      order_journal*      m_journal;
+      const note_links*   m_links;
+      funds_ledger*       m_ledger;
+      const market_clock* m_clock;
+      market_feed*        m_feed;
+      uint32_t            m_shard;
+      uint32_t            m_shards;
+      note_table          m_notes;
+      note_groups         m_groups;   // linked notes by note handle, empty if not linked
+      book_map            m_books;
+      book_list           m_pairs;    // books by pair handle
+      book_list           m_touched;  // books that traded since their stops were checked
+      order_pool*         m_pool;
+      auction_map         m_auctions;
+      uint64_t            m_next_seq;
+      timer_wheel         m_timers;
+      pending_queue*      m_pending;  // orders waiting for their start_date
+      order_index*        m_index;    // open orders by order id and by owner
   };
 
 }
@@ -0,0 +1,187 @@
+#include <ltl/market.hpp>
+#include <ltl/market_writer.hpp>
+#include <ltl/market_clock.hpp>
+#include <ltl/order_book.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <log/log.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+
+namespace po = boost::program_options;
+typedef boost::chrono::high_resolution_clock hr_clock;
+
+/**
+ *  Counts what the market would write and measures how long after its
+ *  submission an order got its first fill.
+ */
+class bench_writer : public ltl::market_writer {
+  public:
+    bench_writer():trades(0),updates(0),first_fill(true){}
+
+    /// called right before the order is handed to the market
+    void start_order() {
+      first_fill = false;
+      started    = hr_clock::now();
+    }
+
+    virtual void add_trade( const std::string&, const std::string&, long long, long long, long long, int, bool, const std::string& ) {
+      ++trades;
+      if( !first_fill ) {
+        first_fill = true;
+        fill_ns.push_back( boost::chrono::duration_cast<boost::chrono::nanoseconds>( hr_clock::now() - started ).count() );
+      }
+    }
+    virtual void update_order( const std::string&, long long, int ) { ++updates; }
+    virtual void amend_order( const std::string&, long long, long long ) { ++updates; }
+    virtual void flush() {}
+
+    uint64_t               trades;
+    uint64_t               updates;
+    bool                   first_fill;
+    hr_clock::time_point   started;
+    std::vector<long long> fill_ns;
+};
+
+static long long percentile( const std::vector<long long>& sorted, double p ) {
+  if( sorted.empty() )
+    return 0;
+  size_t i = size_t( p * ( sorted.size() - 1 ) );
+  return sorted[i];
+}
+
+static void report( const char* name, std::vector<long long>& ns ) {
+  std::sort( ns.begin(), ns.end() );
+  printf( "%-16s %10zu samples   p50 %8lld ns   p99 %8lld ns   p999 %8lld ns   max %8lld ns\n", name, ns.size(),
+          percentile( ns, 0.5 ), percentile( ns, 0.99 ), percentile( ns, 0.999 ), ns.empty() ? 0 : ns.back() );
+}
+
+/**
+ *  Drives one ltl::market on the calling thread with synthetic order flow
+ *  and reports throughput and latency.  The flow only depends on the
+ *  options, so runs with the same seed are directly comparable.
+ */
+int main( int argc, char** argv ) {
+  try {
+    uint64_t    orders;
+    uint32_t    pairs;
+    uint32_t    owners;
+    double      cancel_ratio;
+    std::string dist;
+    long long   mid;
+    double      spread;
+    long long   max_qty;
+    double      min_unit_ratio;
+    uint32_t    seed;
+
+    po::options_description desc( "market_bench options" );
+    desc.add_options()
+      ( "help", "print this message" )
+      ( "orders",   po::value<uint64_t>(&orders)->default_value(1000000), "orders and cancels to submit" )
+      ( "pairs",    po::value<uint32_t>(&pairs)->default_value(1), "number of (stock, currency) pairs" )
+      ( "owners",   po::value<uint32_t>(&owners)->default_value(1000), "number of order owners" )
+      ( "cancels",  po::value<double>(&cancel_ratio)->default_value(0.3), "fraction of events that cancel an earlier order" )
+      ( "dist",     po::value<std::string>(&dist)->default_value("normal"), "price distribution, normal or uniform" )
+      ( "mid",      po::value<long long>(&mid)->default_value(10000), "price the flow is centered on" )
+      ( "spread",   po::value<double>(&spread)->default_value(20), "standard deviation (normal) or half width (uniform) of prices" )
+      ( "max-qty",  po::value<long long>(&max_qty)->default_value(100), "largest order quantity" )
+      ( "min-unit", po::value<double>(&min_unit_ratio)->default_value(0), "fraction of orders with min_unit set to their quantity" )
+      ( "seed",     po::value<uint32_t>(&seed)->default_value(1), "random seed" );
+
+    po::variables_map vm;
+    po::store( po::parse_command_line( argc, argv, desc ), vm );
+    po::notify( vm );
+    if( vm.count( "help" ) ) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+    if( dist != "normal" && dist != "uniform" ) {
+      std::cerr << "unknown price distribution '" << dist << "'\n";
+      return 1;
+    }
+    if( pairs == 0 ) pairs = 1;
+    if( owners == 0 ) owners = 1;
+
+    boost::random::mt19937                         rng( seed );
+    boost::random::uniform_real_distribution<>     unit( 0, 1 );
+    boost::random::normal_distribution<>           normal_price( double(mid), spread );
+    boost::random::uniform_real_distribution<>     uniform_price( mid - spread, mid + spread );
+    boost::random::uniform_int_distribution<long long> qty( 1, max_qty );
+    boost::random::uniform_int_distribution<uint32_t>  pair( 0, pairs - 1 );
+    boost::random::uniform_int_distribution<uint32_t>  owner( 0, owners - 1 );
+
+    // the flow is generated up front so that only matching is timed
+    std::vector<ltl::order_entry> flow;
+    std::vector<bool>             is_cancel;
+    flow.reserve( orders );
+    is_cancel.reserve( orders );
+    uint64_t submitted = 0;
+    for( uint64_t i = 0; i < orders; ++i ) {
+      ltl::order_entry e;
+      if( submitted && unit( rng ) < cancel_ratio ) {
+        e.id = "o" + boost::lexical_cast<std::string>( boost::random::uniform_int_distribution<uint64_t>( 0, submitted - 1 )( rng ) );
+        flow.push_back( e );
+        is_cancel.push_back( true );
+        continue;
+      }
+      double p = dist == "normal" ? normal_price( rng ) : uniform_price( rng );
+      e.id           = "o" + boost::lexical_cast<std::string>( submitted++ );
+      e.owner        = "owner" + boost::lexical_cast<std::string>( owner( rng ) );
+      e.stock_note   = "stock" + boost::lexical_cast<std::string>( pair( rng ) );
+      e.cur_note     = "currency";
+      e.type         = unit( rng ) < 0.5 ? ltl::market_order::buy : ltl::market_order::sell;
+      e.price        = (std::max)( 1LL, (long long)( p + 0.5 ) );
+      e.num_unfilled = qty( rng );
+      e.min_unit     = unit( rng ) < min_unit_ratio ? e.num_unfilled : 0;
+      e.end_date     = 365LL*24*60*60*1000; // the clock moves 1 ms per event
+      flow.push_back( e );
+      is_cancel.push_back( false );
+    }
+
+    ltl::dbo::Session   session;
+    bench_writer        writer;
+    ltl::virtual_clock  clock( 1 );
+    ltl::market         mark( session, writer, 0, 1, 0, 0, 0, &clock );
+
+    std::vector<long long> submit_ns, cancel_ns;
+    submit_ns.reserve( submitted );
+    cancel_ns.reserve( orders - submitted );
+
+    hr_clock::time_point start = hr_clock::now();
+    for( uint64_t i = 0; i < flow.size(); ++i ) {
+      clock.advance( 1 );
+      hr_clock::time_point t = hr_clock::now();
+      if( is_cancel[i] ) {
+        mark.cancel_order( flow[i].id );
+        cancel_ns.push_back( boost::chrono::duration_cast<boost::chrono::nanoseconds>( hr_clock::now() - t ).count() );
+      } else {
+        writer.start_order();
+        mark.submit_order( flow[i] );
+        submit_ns.push_back( boost::chrono::duration_cast<boost::chrono::nanoseconds>( hr_clock::now() - t ).count() );
+      }
+    }
+    double secs = boost::chrono::duration_cast<boost::chrono::duration<double> >( hr_clock::now() - start ).count();
+
+    printf( "%llu events (%llu orders, %llu cancels) on %u pairs in %.3f s, %.0f events/s\n",
+            (unsigned long long)flow.size(), (unsigned long long)submitted,
+            (unsigned long long)( flow.size() - submitted ), pairs, secs, flow.size() / secs );
+    printf( "%llu trades, %llu order updates\n", (unsigned long long)writer.trades, (unsigned long long)writer.updates );
+    report( "submit", submit_ns );
+    report( "order to fill", writer.fill_ns );
+    report( "cancel", cancel_ns );
+  } catch ( const boost::exception& e ) {
+    elog( "%1%", boost::diagnostic_information(e) );
+    return 1;
+  } catch ( const std::exception& e ) {
+    elog( "%1%", boost::diagnostic_information(e) );
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,18 @@
+#include <ltl/market_clock.hpp>
+#include <ltl/date_time.hpp>
+
+namespace ltl {
+
+  class system_market_clock : public market_clock {
+    public:
+      virtual long long now()const {
+        return to_milliseconds( to_ptime( system_clock::now() ) );
+      }
+  };
+
+  market_clock& market_clock::system() {
+    static system_market_clock c;
+    return c;
+  }
+
+} // namespace ltl
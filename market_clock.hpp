@@ -0,0 +1,38 @@
+#ifndef _LTL_MARKET_CLOCK_HPP_
+#define _LTL_MARKET_CLOCK_HPP_
+
+namespace ltl {
+
+  /**
+   *  Source of the time a market matches at, in utc ms.
+   */
+  class market_clock {
+    public:
+      virtual ~market_clock(){}
+      virtual long long now()const = 0;
+
+      /// the wall clock
+      static market_clock& system();
+  };
+
+  /**
+   *  A clock that only moves when it is told to, so that recorded order
+   *  flow can be replayed as fast as it can be matched.
+   */
+  class virtual_clock : public market_clock {
+    public:
+      virtual_clock( long long start = 0 ):m_now(start){}
+
+      virtual long long now()const { return m_now; }
+
+      /// moves the clock to t, a clock never runs backwards
+      void set( long long t )          { if( t > m_now ) m_now = t; }
+      void advance( long long ms )     { m_now += ms; }
+
+    private:
+      long long m_now;
+  };
+
+} // namespace ltl
+
+#endif
@@ -0,0 +1,135 @@
+#include <ltl/market_feed.hpp>
+#include <ltl/error.hpp>
+#include <algorithm>
+
+namespace ltl {
+
+  void market_subscription::push( const depth_delta& d ) {
+    scoped_lock lock(m_mutex);
+    m_levels[std::make_pair( d.side, d.price )] = d;
+    m_seq = d.seq;
+  }
+
+  uint64_t market_subscription::poll( std::vector<depth_delta>& out ) {
+    level_map levels;
+    uint64_t  seq;
+    {
+      scoped_lock lock(m_mutex);
+      levels.swap( m_levels );
+      seq = m_seq;
+    }
+    out.reserve( out.size() + levels.size() );
+    for( level_map::const_iterator itr = levels.begin(); itr != levels.end(); ++itr )
+      out.push_back( itr->second );
+    return seq;
+  }
+
+  uint32_t market_subscription::pending()const {
+    scoped_lock lock(m_mutex);
+    return m_levels.size();
+  }
+
+  void feed_channel::publish( const depth_delta& d ) {
+    if( m_count.load( boost::memory_order_relaxed ) == 0 )
+      return;
+    scoped_lock lock(m_mutex);
+    for( uint32_t i = 0; i < m_subs.size(); ++i )
+      m_subs[i]->push( d );
+  }
+
+  void feed_channel::publish_quote( const book_quote& q ) {
+    if( m_version.load( boost::memory_order_relaxed ) != 0 &&
+        q.bid == m_published.bid && q.bid_quantity == m_published.bid_quantity &&
+        q.ask == m_published.ask && q.ask_quantity == m_published.ask_quantity &&
+        q.last_price == m_published.last_price )
+      return;
+    m_published = q;
+
+    uint32_t v = m_version.load( boost::memory_order_relaxed );
+    m_version.store( v + 1, boost::memory_order_relaxed );
+    boost::atomic_thread_fence( boost::memory_order_release );
+    m_quote[0].store( q.bid,          boost::memory_order_relaxed );
+    m_quote[1].store( q.bid_quantity, boost::memory_order_relaxed );
+    m_quote[2].store( q.ask,          boost::memory_order_relaxed );
+    m_quote[3].store( q.ask_quantity, boost::memory_order_relaxed );
+    m_quote[4].store( q.last_price,   boost::memory_order_relaxed );
+    m_quote_seq.store( q.seq,         boost::memory_order_relaxed );
+    m_version.store( v + 2, boost::memory_order_release );
+  }
+
+  book_quote feed_channel::get_quote()const {
+    book_quote q;
+    while( true ) {
+      uint32_t v = m_version.load( boost::memory_order_acquire );
+      if( v & 1 )
+        continue;
+      q.bid          = m_quote[0].load( boost::memory_order_relaxed );
+      q.bid_quantity = m_quote[1].load( boost::memory_order_relaxed );
+      q.ask          = m_quote[2].load( boost::memory_order_relaxed );
+      q.ask_quantity = m_quote[3].load( boost::memory_order_relaxed );
+      q.last_price   = m_quote[4].load( boost::memory_order_relaxed );
+      q.seq          = m_quote_seq.load( boost::memory_order_relaxed );
+      boost::atomic_thread_fence( boost::memory_order_acquire );
+      if( m_version.load( boost::memory_order_relaxed ) == v )
+        return q;
+    }
+  }
+
+  bool market_feed::get_quote( const std::string& stock_note, const std::string& cur_note, book_quote& q ) {
+    feed_channel* c;
+    {
+      scoped_lock lock(m_mutex);
+      // unknown notes are not interned, a quote request never grows the table
+      pair_key                    key = m_notes.find_pair( stock_note, cur_note );
+      channel_map::const_iterator itr = m_channels.find( key );
+      if( itr == m_channels.end() )
+        return false;
+      c = itr->second;
+    }
+    if( c->m_version.load( boost::memory_order_acquire ) == 0 )
+      return false;
+    q = c->get_quote();
+    return true;
+  }
+
+  market_feed::~market_feed() {
+    for( channel_map::iterator itr = m_channels.begin(); itr != m_channels.end(); ++itr )
+      delete itr->second;
+  }
+
+  feed_channel* market_feed::get_channel( const std::string& stock_note, const std::string& cur_note ) {
+    scoped_lock lock(m_mutex);
+    feed_channel*& c = m_channels[make_pair_key( m_notes.intern( stock_note ), m_notes.intern( cur_note ) )];
+    if( !c )
+      c = new feed_channel();
+    return c;
+  }
+
+  feed_channel* market_feed::find_channel( const std::string& stock_note, const std::string& cur_note ) {
+    scoped_lock lock(m_mutex);
+    // unknown notes are not interned, a subscriber never grows the table
+    channel_map::const_iterator itr = m_channels.find( m_notes.find_pair( stock_note, cur_note ) );
+    return itr == m_channels.end() ? 0 : itr->second;
+  }
+
+  market_subscription_ptr market_feed::subscribe( const std::string& stock_note, const std::string& cur_note ) {
+    feed_channel* c = find_channel( stock_note, cur_note );
+    if( !c ) { LTL_THROW( "No market for %1%/%2%", %stock_note %cur_note ); }
+    market_subscription_ptr s( new market_subscription() );
+    feed_channel::scoped_lock lock(c->m_mutex);
+    c->m_subs.push_back( s );
+    c->m_count.store( c->m_subs.size() );
+    return s;
+  }
+
+  void market_feed::unsubscribe( const std::string& stock_note, const std::string& cur_note,
+                                 const market_subscription_ptr& s ) {
+    feed_channel* c = find_channel( stock_note, cur_note );
+    if( !c )
+      return;
+    feed_channel::scoped_lock lock(c->m_mutex);
+    c->m_subs.erase( std::remove( c->m_subs.begin(), c->m_subs.end(), s ), c->m_subs.end() );
+    c->m_count.store( c->m_subs.size() );
+  }
+
+} // namespace ltl
@@ -0,0 +1,145 @@
+#ifndef _LTL_MARKET_FEED_HPP_
+#define _LTL_MARKET_FEED_HPP_
+#include <ltl/order_book.hpp>
+#include <ltl/note_table.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
+#include <vector>
+
+namespace ltl {
+
+  /**
+   *  Best bid and ask of a pair with the quantity at each and the price
+   *  of the last trade, 0 where there is none.  seq is the depth seq the
+   *  quote reflects.
+   */
+  struct book_quote {
+    book_quote():bid(0),bid_quantity(0),ask(0),ask_quantity(0),last_price(0),seq(0){}
+
+    long long bid;
+    long long bid_quantity;
+    long long ask;
+    long long ask_quantity;
+    long long last_price;
+    uint64_t  seq;
+  };
+
+  /**
+   *  The depth changes of one pair not yet taken by one subscriber,
+   *  conflated per price level: a level that changes several times
+   *  between two polls is delivered once in its latest state.  What a
+   *  slow subscriber has pending is bounded by the number of levels of
+   *  the book, never by the number of changes.
+   *
+   *  Every update is the complete state of its level, so applying one
+   *  again is harmless.  A subscriber should subscribe before it takes a
+   *  depth snapshot and ignore updates with a seq up to the snapshot's.
+   */
+  class market_subscription {
+    public:
+      market_subscription():m_seq(0){}
+
+      /**
+       *  Moves the pending updates into out, bids then asks, each by
+       *  price.
+       *
+       *  @return the seq of the newest depth change seen so far
+       */
+      uint64_t poll( std::vector<depth_delta>& out );
+
+      /// number of levels with an update waiting
+      uint32_t pending()const;
+
+    private:
+      friend class feed_channel;
+      typedef boost::mutex::scoped_lock                        scoped_lock;
+      typedef std::map<std::pair<int,long long>, depth_delta>  level_map;
+
+      void push( const depth_delta& d );
+
+      mutable boost::mutex m_mutex;
+      level_map            m_levels;
+      uint64_t             m_seq;
+  };
+
+  typedef boost::shared_ptr<market_subscription> market_subscription_ptr;
+
+  /**
+   *  Subscribers and top of book of one pair.  The book of the pair
+   *  publishes every depth change to its channel on the matching thread,
+   *  which only ever holds a subscriber's lock long enough to overwrite
+   *  one level, so it never waits for a subscriber to send.  Without
+   *  subscribers publishing takes no lock.
+   *
+   *  The quote is a seqlock: the single writer bumps the version to odd,
+   *  stores the fields and bumps it to even again, readers retry until
+   *  they saw the same even version before and after copying.  Neither
+   *  side ever blocks the other.
+   */
+  class feed_channel {
+    public:
+      feed_channel():m_count(0),m_version(0){}
+
+      void publish( const depth_delta& d );
+
+      /// called by the book's thread only, skips quotes that did not change
+      void publish_quote( const book_quote& q );
+
+      /// may be called from any thread
+      book_quote get_quote()const;
+
+    private:
+      friend class market_feed;
+      typedef boost::mutex::scoped_lock scoped_lock;
+
+      boost::mutex                          m_mutex;
+      std::vector<market_subscription_ptr>  m_subs;
+      boost::atomic<uint32_t>               m_count;
+
+      book_quote                            m_published; // writer's copy
+      boost::atomic<uint32_t>               m_version;
+      boost::atomic<long long>              m_quote[5];  // bid, bid_quantity, ask, ask_quantity, last_price
+      boost::atomic<uint64_t>               m_quote_seq;
+  };
+
+  /**
+   *  Push subscriptions to the depth of every pair, see
+   *  market_subscription.  Channels are created by the first book of
+   *  their pair and live as long as the feed.
+   */
+  class market_feed {
+    public:
+      ~market_feed();
+
+      feed_channel*           get_channel( const std::string& stock_note, const std::string& cur_note );
+
+      /**
+       *  @return false if no book of the pair has published a quote
+       */
+      bool                    get_quote( const std::string& stock_note, const std::string& cur_note,
+                                         book_quote& q );
+
+      /**
+       *  Throws if no book of the pair has been created.
+       */
+      market_subscription_ptr subscribe( const std::string& stock_note, const std::string& cur_note );
+      void                    unsubscribe( const std::string& stock_note, const std::string& cur_note,
+                                           const market_subscription_ptr& s );
+
+    private:
+      typedef boost::mutex::scoped_lock                           scoped_lock;
+      typedef boost::unordered_map<pair_key, feed_channel*>       channel_map;
+
+      feed_channel* find_channel( const std::string& stock_note, const std::string& cur_note );
+
+      boost::mutex m_mutex;
+      note_table   m_notes;
+      channel_map  m_channels;
+  };
+
+} // namespace ltl
+
+#endif
@@ -0,0 +1,628 @@
+#include <ltl/market_writer.hpp>
+#include <ltl/funds_ledger.hpp>
+#include <ltl/persist.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <log/log.hpp>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <set>
+
+namespace ltl {
+
+  struct trade_record {
+    std::string buy_order_id;
+    std::string sell_order_id;
+    long long   num;
+    long long   price;
+    long long   timestamp;
+    int         implied;  // side that traded through an implied route, 0 if neither
+    bool        bridge;   // the bridge trade of that route, linked note for currency
+    std::string key;      // order_journal key
+    bool        redo;     // replayed from the journal, may have been committed already
+  };
+
+  struct order_record {
+    long long num_unfilled;
+    int       status;
+    long long price;  // 0 if not amended
+  };
+
+  typedef boost::unordered_map<std::string, order_record> order_records;
+
+  /**
+   *  Fills of one order since its last fill transaction.
+   */
+  struct fill_record {
+    fill_record():count(0),open_legs(0),failures(0),num(0),notional(0){}
+
+    uint32_t           count;
+    uint32_t           open_legs; // implied legs whose bridge has not been written yet
+    uint32_t           failures;  // fill transactions that could not be committed
+    long long          num;
+    long long          notional;  // sum of num * price
+    boost::system_time first;     // when the oldest was written, pushed back after a failure
+  };
+
+  /// orders by when their first unsealed fill was written
+  static bool by_first( const std::pair<boost::system_time, std::string>& a,
+                        const std::pair<boost::system_time, std::string>& b ) {
+    return a.first < b.first;
+  }
+
+  typedef boost::unordered_map<std::string, fill_record> fill_records;
+
+  /**
+   *  Attempts after which an error that is not a busy or locked database
+   *  is taken to be permanent, about a second.
+   */
+  static const uint32_t max_attempts = 100;
+
+  /**
+   *  @return true if another connection holds the database, which is
+   *          the one error worth retrying indefinitely
+   */
+  static bool is_busy( const std::exception& e ) {
+    return boost::algorithm::icontains( e.what(), "locked" ) ||
+           boost::algorithm::icontains( e.what(), "busy" );
+  }
+
+  struct settlement {
+    std::string account;
+    long long   num;
+  };
+
+  class market_writer_private {
+    public:
+      typedef boost::mutex::scoped_lock scoped_lock;
+
+      market_writer_private( const dbo::SqlConnection& c, uint32_t lag, uint32_t maxb,
+                             funds_ledger* ledger, uint32_t seal_fills, uint32_t seal_ms )
+      :m_conn( c.clone() ),m_max_lag(lag),m_max_batch(maxb),
+       m_ledger(ledger),m_seal_fills(seal_fills),m_seal_ms(seal_ms),
+       m_queued(0),m_taken(0),m_written(0),m_flush(false),m_quit(false) {
+        m_session.setConnection( *m_conn );
+        map_classes( m_session );
+        m_thread = boost::thread( boost::bind( &market_writer_private::run, this ) );
+      }
+
+      ~market_writer_private() {
+        {
+          scoped_lock lock(m_mutex);
+          m_quit = true;
+          m_work.notify_all();
+        }
+        m_thread.join();
+      }
+
+      /**
+       *  Called with m_mutex held after a write has been queued.  Never
+       *  waits for the writer, the caller may have a transaction open
+       *  that the writer is waiting for.
+       */
+      void queued() {
+        if( m_queued == m_taken )
+          m_oldest = boost::get_system_time();
+        ++m_queued;
+        if( m_queued - m_taken >= m_max_batch )
+          m_work.notify_all();
+      }
+
+      void add_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                      long long num, long long price, long long timestamp,
+                      int implied, bool bridge, const std::string& key, bool redo );
+
+      void run() {
+        while( true ) {
+          std::vector<trade_record> trades;
+          order_records             orders;
+          uint64_t                  target;
+          bool                      last;
+          {
+            scoped_lock lock(m_mutex);
+            // unsealed fills wake the writer when the oldest of them is due
+            while( !m_quit && m_queued == m_taken && !seal_due() ) {
+              if( m_seal_queue.empty() )
+                m_work.wait( lock );
+              else
+                m_work.timed_wait( lock, m_seal_queue.front().first + boost::posix_time::milliseconds(m_seal_ms) );
+            }
+            last = m_quit && m_queued == m_taken;
+
+            if( m_queued != m_taken ) {
+              // let the batch grow until it is as old as the allowed lag
+              boost::system_time deadline = m_oldest + boost::posix_time::milliseconds(m_max_lag);
+              while( !m_quit && !m_flush && m_queued - m_taken < m_max_batch ) {
+                if( !m_work.timed_wait( lock, deadline ) )
+                  break;
+              }
+              m_flush = false;
+              trades.swap( m_trades );
+              orders.swap( m_orders );
+            }
+            target = m_taken = m_queued;
+          }
+
+          write( trades, orders, last );
+
+          scoped_lock lock(m_mutex);
+          m_written = target;
+          m_done.notify_all();
+          if( last )
+            return;
+        }
+      }
+
+      /**
+       *  @return true if the oldest unsealed fill has waited seal_ms,
+       *          forgetting queue entries of orders sealed since.
+       */
+      bool seal_due() {
+        while( m_seal_queue.size() ) {
+          fill_records::const_iterator itr = m_unsealed.find( m_seal_queue.front().second );
+          if( itr != m_unsealed.end() && itr->second.first == m_seal_queue.front().first )
+            return m_seal_queue.front().first + boost::posix_time::milliseconds(m_seal_ms) <= boost::get_system_time();
+          m_seal_queue.pop_front();
+        }
+        return false;
+      }
+
+      /**
+       *  Drops the trades replayed from the journal whose rows were
+       *  committed before the restart.
+       */
+      void drop_committed( std::vector<trade_record>& trades ) {
+        uint32_t redo = 0;
+        for( uint32_t i = 0; i < trades.size(); ++i )
+          redo += trades[i].redo;
+        if( !redo )
+          return;
+
+        std::vector<trade_record> keep;
+        if( !try_commit( boost::bind( &market_writer_private::keep_uncommitted, this, boost::cref(trades), boost::ref(keep) ),
+                         "the lookup of replayed trades" ) ) {
+          elog( "market writer: writing all %1% replayed trades, some may be duplicated", redo );
+          return;
+        }
+        slog( "market writer: %1% of %2% replayed trades were already committed", trades.size() - keep.size(), redo );
+        trades.swap( keep );
+      }
+
+      void keep_uncommitted( const std::vector<trade_record>& trades, std::vector<trade_record>& keep ) {
+        keep.clear();
+        for( uint32_t i = 0; i < trades.size(); ++i ) {
+          if( trades[i].redo && m_session.find<market_trade>().where( "journal_key = ?" ).bind( trades[i].key ).resultList().size() )
+            continue;
+          keep.push_back( trades[i] );
+        }
+      }
+
+      /**
+       *  Runs op in a transaction until it commits.  A busy or locked
+       *  database is retried for as long as it lasts, any other error
+       *  max_attempts times.  Order rows are committed before their orders
+       *  reach the engine, so a missing row does not heal by waiting.
+       *
+       *  @return false if op failed for good, nothing of it was committed
+       */
+      template<typename Op>
+      bool try_commit( Op op, const std::string& what ) {
+        for( uint32_t attempt = 0; ; ++attempt ) {
+          try {
+            dbo::Transaction dbtrx(m_session);
+            op();
+            dbtrx.commit();
+            return true;
+          } catch ( const std::exception& e ) {
+            m_session.rereadAll();
+            if( !is_busy( e ) && attempt + 1 >= max_attempts ) {
+              elog( "market writer: giving up on %1%: %2%", what, boost::diagnostic_information(e) );
+              return false;
+            }
+            if( attempt % 100 == 0 )
+              wlog( "market writer: %1%, retrying", boost::diagnostic_information(e) );
+            boost::this_thread::sleep( boost::posix_time::milliseconds(10) );
+          }
+        }
+      }
+
+      void add_fill( const std::string& order_id, long long num, long long notional ) {
+        fill_record& f = m_unsealed[order_id];
+        if( f.count++ == 0 ) {
+          f.first = boost::get_system_time();
+          m_seal_queue.push_back( std::make_pair( f.first, order_id ) );
+        }
+        f.num      += num;
+        f.notional += notional;
+      }
+
+      /**
+       *  Credits both orders of the trade.  The implied side of a route
+       *  gets the stock of its leg and the currency of its bridge: q at
+       *  the leg price for qb = q * leg price notes, then qb notes at the
+       *  bridge price, which is q at the implied price.
+       */
+      void add_fills( const trade_record& t ) {
+        long long notional = t.num * t.price;
+        if( t.implied == market_order::buy )
+          add_implied_fill( t.buy_order_id, t, notional );
+        else
+          add_fill( t.buy_order_id, t.num, notional );
+        if( t.implied == market_order::sell )
+          add_implied_fill( t.sell_order_id, t, notional );
+        else
+          add_fill( t.sell_order_id, t.num, notional );
+      }
+
+      void add_implied_fill( const std::string& order_id, const trade_record& t, long long notional ) {
+        if( t.bridge ) {
+          add_fill( order_id, 0, notional );
+          --m_unsealed[order_id].open_legs;
+        } else {
+          add_fill( order_id, t.num, 0 );
+          ++m_unsealed[order_id].open_legs;
+        }
+      }
+
+      /**
+       *  Commits one batch, see try_commit.  A batch that fails for good
+       *  is written record by record so one bad record cannot wedge the
+       *  writer and flush(); the records that still fail are logged and
+       *  dropped.
+       *
+       *  Orders closed by the batch, orders with seal_fills unsealed
+       *  fills and orders whose oldest unsealed fill is due get their fill
+       *  transaction in the same commit, every order does if all is set.
+       */
+      void write( std::vector<trade_record>& trades, const order_records& orders, bool all ) {
+        drop_committed( trades );
+        for( uint32_t i = 0; i < trades.size(); ++i )
+          add_fills( trades[i] );
+
+        std::set<std::string> seal;
+        if( all ) {
+          for( fill_records::const_iterator itr = m_unsealed.begin(); itr != m_unsealed.end(); ++itr )
+            seal.insert( itr->first );
+        }
+        for( uint32_t i = 0; i < trades.size(); ++i ) {
+          if( m_unsealed[trades[i].buy_order_id].count >= m_seal_fills )  seal.insert( trades[i].buy_order_id );
+          if( m_unsealed[trades[i].sell_order_id].count >= m_seal_fills ) seal.insert( trades[i].sell_order_id );
+        }
+        for( order_records::const_iterator itr = orders.begin(); itr != orders.end(); ++itr ) {
+          if( itr->second.status != market_order::open && m_unsealed.count( itr->first ) )
+            seal.insert( itr->first );
+        }
+        boost::system_time now = boost::get_system_time();
+        for( uint32_t i = 0; i < m_seal_queue.size() && m_seal_queue[i].first + boost::posix_time::milliseconds(m_seal_ms) <= now; ++i ) {
+          fill_records::const_iterator itr = m_unsealed.find( m_seal_queue[i].second );
+          if( itr != m_unsealed.end() && itr->second.first == m_seal_queue[i].first )
+            seal.insert( itr->first );
+        }
+        if( !all ) {
+          // the two trades of a route can be queued in different batches, a fill
+          // transaction must not hold the stock of a leg without the currency of its bridge
+          for( std::set<std::string>::iterator itr = seal.begin(); itr != seal.end(); ) {
+            if( m_unsealed[*itr].open_legs )
+              seal.erase( itr++ );
+            else
+              ++itr;
+          }
+        }
+        if( trades.empty() && orders.empty() && seal.empty() )
+          return;
+
+        std::vector<settlement> settled;
+        std::vector<sha1>       changed;
+        if( !try_commit( boost::bind( &market_writer_private::write_rows, this, boost::cref(trades), boost::cref(orders),
+                                      boost::cref(seal), boost::ref(settled), boost::ref(changed) ), "a batch" ) )
+          write_each( trades, orders, seal, settled, changed, all );
+
+        for( std::set<std::string>::const_iterator itr = seal.begin(); itr != seal.end(); ++itr )
+          m_unsealed.erase( *itr );
+        // other sessions must reread the accounts before the ledger asks them for funds again
+        if( m_accounts_changed && changed.size() )
+          m_accounts_changed( changed );
+        if( m_ledger && settled.size() )
+          settle( settled );
+      }
+
+      /**
+       *  Tells the ledger the fills were posted and reseeds the accounts
+       *  with their balances as this session reads them after the commit,
+       *  the copies other sessions hold may not have been reread yet.
+       */
+      void settle( const std::vector<settlement>& settled ) {
+        std::vector<uint64_t> versions;
+        for( uint32_t i = 0; i < settled.size(); ++i )
+          versions.push_back( m_ledger->version( settled[i].account ) );
+
+        std::vector<int64_t> funds;
+        if( !try_commit( boost::bind( &market_writer_private::read_funds, this, boost::cref(settled), boost::ref(funds) ),
+                         "the funds of settled accounts" ) )
+          funds.clear();
+
+        for( uint32_t i = 0; i < settled.size(); ++i ) {
+          if( funds.size() )
+            m_ledger->settle( settled[i].account, settled[i].num, funds[i], versions[i] );
+          else
+            m_ledger->settle( settled[i].account, settled[i].num );
+        }
+      }
+
+      void read_funds( const std::vector<settlement>& settled, std::vector<int64_t>& funds ) {
+        funds.clear();
+        std::set<std::string> reread;
+        for( uint32_t i = 0; i < settled.size(); ++i ) {
+          dbo::ptr<account> a = m_session.load<account>( settled[i].account );
+          if( reread.insert( settled[i].account ).second ) {
+            a.reread();
+            a = m_session.load<account>( settled[i].account );
+          }
+          funds.push_back( a->get_unreserved_balance() );
+        }
+      }
+
+      void write_rows( const std::vector<trade_record>& trades, const order_records& orders, const std::set<std::string>& seal,
+                       std::vector<settlement>& settled, std::vector<sha1>& changed ) {
+        settled.clear();
+        changed.clear();
+        for( uint32_t i = 0; i < trades.size(); ++i ) {
+          const trade_record& t = trades[i];
+          market_trade::ptr mt = m_session.add( new market_trade( load_order( t.buy_order_id ),
+                                                                  load_order( t.sell_order_id ) ) );
+          mt.modify()->num         = t.num;
+          mt.modify()->price       = t.price;
+          mt.modify()->timestamp   = t.timestamp;
+          mt.modify()->journal_key = t.key;
+        }
+        for( order_records::const_iterator itr = orders.begin(); itr != orders.end(); ++itr ) {
+          market_order::ptr mo = load_order( itr->first );
+          mo.modify()->num_unfilled = itr->second.num_unfilled;
+          mo.modify()->status       = itr->second.status;
+          if( itr->second.price )
+            mo.modify()->price      = itr->second.price;
+        }
+        for( std::set<std::string>::const_iterator itr = seal.begin(); itr != seal.end(); ++itr )
+          seal_fills( *itr, m_unsealed[*itr], settled, changed );
+      }
+
+      /**
+       *  Commits every record of a failed batch on its own, the records
+       *  that still fail are logged for the operator and dropped.  A
+       *  fill transaction that fails is removed from seal and retried
+       *  later instead: its fills hold unsettled funds in the ledger until
+       *  they are posted.  Only the last batch, all, drops them.
+       */
+      void write_each( const std::vector<trade_record>& trades, const order_records& orders, std::set<std::string>& seal,
+                       std::vector<settlement>& settled, std::vector<sha1>& changed, bool all ) {
+        std::vector<trade_record> no_trades;
+        order_records             no_orders;
+        std::set<std::string>     no_seal;
+        std::vector<settlement>   s;
+        std::vector<sha1>         c;
+        settled.clear();
+        changed.clear();
+        for( uint32_t i = 0; i < trades.size(); ++i ) {
+          const trade_record& t = trades[i];
+          std::vector<trade_record> one( 1, t );
+          if( !try_commit( boost::bind( &market_writer_private::write_rows, this, boost::cref(one), boost::cref(no_orders),
+                                        boost::cref(no_seal), boost::ref(s), boost::ref(c) ), "a trade" ) )
+            elog( "market writer: dropped trade of %1% @ %2% between %3% and %4%, key %5%",
+                  t.num, t.price, t.buy_order_id, t.sell_order_id, t.key );
+        }
+        for( order_records::const_iterator itr = orders.begin(); itr != orders.end(); ++itr ) {
+          order_records one;
+          one.insert( *itr );
+          if( !try_commit( boost::bind( &market_writer_private::write_rows, this, boost::cref(no_trades), boost::cref(one),
+                                        boost::cref(no_seal), boost::ref(s), boost::ref(c) ), "an order" ) )
+            elog( "market writer: dropped update of order %1% to %2% unfilled, status %3%, price %4%",
+                  itr->first, itr->second.num_unfilled, itr->second.status, itr->second.price );
+        }
+        for( std::set<std::string>::iterator itr = seal.begin(); itr != seal.end(); ) {
+          std::set<std::string> one;
+          one.insert( *itr );
+          if( try_commit( boost::bind( &market_writer_private::write_rows, this, boost::cref(no_trades), boost::cref(no_orders),
+                                       boost::cref(one), boost::ref(s), boost::ref(c) ), "a fill transaction" ) ) {
+            settled.insert( settled.end(), s.begin(), s.end() );
+            changed.insert( changed.end(), c.begin(), c.end() );
+            ++itr;
+            continue;
+          }
+          fill_record& f = m_unsealed[*itr];
+          if( all ) {
+            elog( "market writer: dropped %1% fills of order %2%, %3% for %4%, funds of account %5% stay unsettled",
+                  f.count, *itr, f.num, f.notional, funds_account_of( *itr ) );
+            ++itr;
+            continue;
+          }
+          retry_seal( *itr, f );
+          seal.erase( itr++ );
+        }
+      }
+
+      /**
+       *  Schedules another attempt at the fill transaction of the order,
+       *  backing off from seal_ms to 64 times that.
+       */
+      void retry_seal( const std::string& order_id, fill_record& f ) {
+        uint32_t delay = m_seal_ms << (std::min)( f.failures++, 6u );
+        // the old queue entry no longer matches and is forgotten
+        f.first = boost::get_system_time() + boost::posix_time::milliseconds( delay ) - boost::posix_time::milliseconds( m_seal_ms );
+        std::pair<boost::system_time, std::string> e( f.first, order_id );
+        m_seal_queue.insert( std::upper_bound( m_seal_queue.begin(), m_seal_queue.end(), e, by_first ), e );
+        elog( "market writer: %1% fills of order %2%, %3% for %4%, not posted, funds of account %5% stay unsettled; retrying in %6% ms",
+              f.count, order_id, f.num, f.notional, funds_account_of( order_id ), delay );
+      }
+
+      /// for the log, the order row may be what cannot be read
+      std::string funds_account_of( const std::string& order_id ) {
+        try {
+          dbo::Transaction dbtrx(m_session);
+          std::string a = load_order( order_id )->funds_account;
+          dbtrx.commit();
+          return a;
+        } catch ( const std::exception& ) {
+          m_session.rereadAll();
+        }
+        std::string a = m_ledger ? m_ledger->account_of( order_id ) : std::string();
+        return a.size() ? a : std::string( "unknown" );
+      }
+
+      /**
+       *  Posts the unsealed fills of the order as one trade action chained
+       *  to its previous fill transaction, or to the order if there is
+       *  none, and makes it the order's fill_trx.
+       */
+      void seal_fills( const std::string& order_id, const fill_record& f,
+                       std::vector<settlement>& settled, std::vector<sha1>& changed ) {
+        market_order::ptr        mo  = load_order( order_id );
+        boost::shared_ptr<offer> off = boost::dynamic_pointer_cast<offer>( mo->order_trx->get_actions()[0] );
+        bool                     buy = mo->type == market_order::buy;
+
+        boost::shared_ptr<trade> t( new trade() );
+        t->offer_trx        = mo->fill_trx ? mo->fill_trx->get_id() : mo->order_trx->get_id();
+        t->asset_account    = off->asset_account;
+        t->currency_account = off->currency_account;
+        t->delta_asset      = buy ? f.num : -f.num;
+        t->delta_currency   = buy ? -f.notional : f.notional;
+
+        std::vector<action::ptr> acts( 1, t );
+        std::stringstream ss;
+        ss << f.count << " fills of order " << order_id;
+        dbo::ptr<transaction> trx = m_session.add( new transaction( acts, ss.str() ) );
+        trx.modify()->apply_by_host();
+        mo.modify()->fill_trx = trx;
+        changed.push_back( t->asset_account );
+        changed.push_back( t->currency_account );
+
+        if( mo->funds_account.size() ) {
+          settlement s;
+          s.account = mo->funds_account;
+          s.num     = buy ? f.notional : f.num;
+          settled.push_back( s );
+        }
+      }
+
+      market_order::ptr load_order( const std::string& id ) {
+        return m_session.load<market_order>( m_session.load<transaction>( id ) );
+      }
+
+      boost::scoped_ptr<dbo::SqlConnection> m_conn;
+      dbo::Session                          m_session;
+      uint32_t                              m_max_lag;
+      uint32_t                              m_max_batch;
+      funds_ledger*                         m_ledger;
+      market_writer::accounts_handler       m_accounts_changed;
+      uint32_t                              m_seal_fills;
+      uint32_t                              m_seal_ms;
+      fill_records                          m_unsealed;    // writer thread only
+      std::deque< std::pair<boost::system_time, std::string> > m_seal_queue; // first unsealed fill per order, oldest first, writer thread only
+
+      boost::mutex                          m_mutex;
+      boost::condition_variable             m_work;
+      boost::condition_variable             m_done;
+      std::vector<trade_record>             m_trades;
+      order_records                         m_orders;
+      uint64_t                              m_queued;   // writes queued since start
+      uint64_t                              m_taken;    // writes handed to the writer thread
+      uint64_t                              m_written;  // writes committed since start
+      boost::system_time                    m_oldest;   // when the oldest uncommitted write was queued
+      bool                                  m_flush;
+      bool                                  m_quit;
+      boost::thread                         m_thread;
+  };
+
+  market_writer::market_writer( const dbo::SqlConnection& conn, uint32_t max_lag_ms, uint32_t max_batch,
+                                funds_ledger* ledger, uint32_t seal_fills, uint32_t seal_ms ) {
+    my = new market_writer_private( conn, max_lag_ms, max_batch, ledger, seal_fills, seal_ms );
+  }
+
+  market_writer::market_writer()
+  :my(0){}
+
+  market_writer::~market_writer() {
+    delete my;
+  }
+
+  void market_writer::add_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                                 long long num, long long price, long long timestamp,
+                                 int implied, bool bridge, const std::string& key ) {
+    my->add_trade( buy_order_id, sell_order_id, num, price, timestamp, implied, bridge, key, false );
+  }
+
+  void market_writer::redo_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                                  long long num, long long price, long long timestamp,
+                                  int implied, bool bridge, const std::string& key ) {
+    if( my )
+      my->add_trade( buy_order_id, sell_order_id, num, price, timestamp, implied, bridge, key, true );
+  }
+
+  uint64_t market_writer::queued()const {
+    if( !my ) return 0;
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    return my->m_queued;
+  }
+
+  uint64_t market_writer::committed()const {
+    if( !my ) return 0;
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    return my->m_written;
+  }
+
+  void market_writer_private::add_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                                         long long num, long long price, long long timestamp,
+                                         int implied, bool bridge, const std::string& key, bool redo ) {
+    scoped_lock lock(m_mutex);
+    trade_record t;
+    t.buy_order_id  = buy_order_id;
+    t.sell_order_id = sell_order_id;
+    t.num           = num;
+    t.price         = price;
+    t.timestamp     = timestamp;
+    t.implied       = implied;
+    t.bridge        = bridge;
+    t.key           = key;
+    t.redo          = redo;
+    m_trades.push_back(t);
+    queued();
+  }
+
+  void market_writer::update_order( const std::string& order_id, long long num_unfilled, int status ) {
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    order_record& o = my->m_orders[order_id];
+    o.num_unfilled = num_unfilled;
+    o.status       = status;
+    my->queued();
+  }
+
+  void market_writer::on_accounts_changed( const accounts_handler& h ) {
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    my->m_accounts_changed = h;
+  }
+
+  void market_writer::amend_order( const std::string& order_id, long long num_unfilled, long long price ) {
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    order_record& o = my->m_orders[order_id];
+    o.num_unfilled = num_unfilled;
+    o.status       = market_order::open;
+    o.price        = price;
+    my->queued();
+  }
+
+  void market_writer::flush() {
+    market_writer_private::scoped_lock lock(my->m_mutex);
+    uint64_t target = my->m_queued;
+    if( my->m_taken < target ) {
+      my->m_flush = true;
+      my->m_work.notify_all();
+    }
+    while( my->m_written < target )
+      my->m_done.wait( lock );
+  }
+
+} // namespace ltl
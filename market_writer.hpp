@@ -0,0 +1,112 @@
+#ifndef _LTL_MARKET_WRITER_HPP_
+#define _LTL_MARKET_WRITER_HPP_
+#include <ltl/dbo_traits.hpp>
+#include <ltl/crypto.hpp>
+#include <boost/function.hpp>
+#include <vector>
+#include <stdint.h>
+#include <string>
+
+namespace ltl {
+
+  class funds_ledger;
+
+  /**
+   *  Persists the results of matching in the background.
+   *
+   *  The market applies every fill to its resident books and hands the
+   *  new state to the writer, which commits it to the database on its own
+   *  connection and thread in batches.  Several updates of the same order
+   *  within a batch are coalesced into one row write.
+   *
+   *  The lag is bounded: a batch is committed as soon as max_batch
+   *  writes are waiting and no later than max_lag_ms after its first
+   *  write was queued.  Queueing never waits for the database, callers
+   *  that need the results on disk call flush().
+   *
+   *  The market_order rows are owned by the writer once they have been
+   *  added, no other session may modify them.
+   *
+   *  Fills are settled into the accounts in batches per order rather
+   *  than per trade: the fills of an order accumulate until it is closed,
+   *  it has seal_fills of them or the oldest is seal_ms old.  They are
+   *  then posted as one trade action in a transaction signed by the host
+   *  and applied to the order's accounts, which becomes the order's
+   *  fill_trx.  Each fill transaction names the previous one, or the
+   *  order, as its authorization.  Fills still accumulating when the
+   *  process dies are only recorded as market_trade rows.
+   *
+   *  Derived writers may record the results elsewhere instead, see
+   *  backtest.
+   */
+  class market_writer {
+    public:
+      typedef boost::function<void(const std::vector<sha1>&)> accounts_handler;
+
+      /**
+       *  @param conn connection to the market database, the writer uses
+       *              its own clone of it.
+       *  @param ledger if given, is told when fills have been settled
+       */
+      market_writer( const dbo::SqlConnection& conn, uint32_t max_lag_ms = 50, uint32_t max_batch = 4096,
+                     funds_ledger* ledger = 0, uint32_t seal_fills = 64, uint32_t seal_ms = 1000 );
+      virtual ~market_writer();
+
+      /**
+       *  @param implied the side that traded through an implied route, 0
+       *                 if neither.  Such a route is queued as two trades,
+       *                 the leg of stock for a linked note and the bridge
+       *                 of that note for currency.  The implied side is
+       *                 settled the stock of the leg and the currency of
+       *                 the bridge, the linked note nets out.
+       *  @param key     order_journal key of the trade, stored with its row
+       */
+      virtual void add_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                              long long num, long long price, long long timestamp,
+                              int implied = 0, bool bridge = false, const std::string& key = std::string() );
+
+      /**
+       *  Queues a trade replayed from the journal, which is skipped if a
+       *  row with its key has already been committed.
+       */
+      void         redo_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                               long long num, long long price, long long timestamp,
+                               int implied, bool bridge, const std::string& key );
+      virtual void update_order( const std::string& order_id, long long num_unfilled, int status );
+      virtual void amend_order( const std::string& order_id, long long num_unfilled, long long price );
+
+      /**
+       *  Blocks until everything queued before the call has been
+       *  committed.  Must not be called while a transaction is open on
+       *  another connection to the database, the writer could not commit.
+       */
+      virtual void flush();
+
+      /**
+       *  Writes queued since start and how many of them have been
+       *  committed, a write is durable once committed() reaches the
+       *  value queued() had after it was queued.  Derived writers that
+       *  keep no queue report 0 for both.
+       */
+      uint64_t     queued()const;
+      uint64_t     committed()const;
+
+      /**
+       *  Calls h from the writer thread with the accounts that fill
+       *  transactions were applied to after they have been committed, so
+       *  that other sessions can reread them.  Must be set before the
+       *  first write is queued.
+       */
+      void on_accounts_changed( const accounts_handler& h );
+
+    protected:
+      /// for derived writers that do not write to a database
+      market_writer();
+
+    private:
+      class market_writer_private* my;
+  };
+
+} // namespace ltl
+
+#endif
@@ -0,0 +1,199 @@
+#include <ltl/matching_engine.hpp>
+#include <ltl/order_book.hpp>
+#include <ltl/order_journal.hpp>
+#include <ltl/date_time.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/exception/all.hpp>
+#include <log/log.hpp>
+
+namespace ltl {
+
+  typedef boost::function<void()> command;
+
+  /**
+   *  One market and the thread that owns it.
+   */
+  class shard {
+    public:
+      typedef boost::mutex::scoped_lock scoped_lock;
+      enum { queue_size = 4096 };
+
+      shard( dbo::Session& s, market_writer& w, uint32_t id, uint32_t count, uint32_t tick_ms,
+             const boost::filesystem::path& journal_dir, uint64_t gen, const note_links& links,
+             funds_ledger* ledger, market_feed* feed )
+      :journal( journal_dir, gen, id ),
+       mark( s, w, id, count, &journal, &links, ledger, 0, feed ),m_tick_ms(tick_ms),m_sleeping(false){}
+
+      ~shard() {
+        post( 0 );
+        m_thread.join();
+        command* c;
+        while( m_queue.pop(c) )
+          delete c;
+      }
+
+      void start() {
+        m_thread = boost::thread( boost::bind( &shard::run, this ) );
+      }
+
+      /**
+       *  Callers take turns being the queue's single producer, a null
+       *  command stops the worker.
+       */
+      void post( command* c ) {
+        {
+          scoped_lock lock(m_post_mutex);
+          while( !m_queue.push( c ) )
+            boost::this_thread::yield();
+        }
+        // pairs with the fence in run() so that either the worker sees the
+        // command before it sleeps or we see that it is asleep
+        boost::atomic_thread_fence( boost::memory_order_seq_cst );
+        if( m_sleeping.load() ) {
+          scoped_lock lock(m_mutex);
+          m_wake.notify_one();
+        }
+      }
+
+      order_journal journal;
+      market        mark;
+
+    private:
+      void run() {
+        long long next_tick = now() + m_tick_ms;
+        while( true ) {
+          command* c;
+          while( m_queue.pop(c) ) {
+            if( !c )
+              return;
+            try {
+              (*c)();
+            } catch ( const boost::exception& e ) {
+              elog( "matching: %1%", boost::diagnostic_information(e) );
+            } catch ( const std::exception& e ) {
+              elog( "matching: %1%", boost::diagnostic_information(e) );
+            }
+            delete c;
+          }
+
+          long long t = now();
+          if( t >= next_tick ) {
+            try {
+              mark.tick( t );
+            } catch ( const boost::exception& e ) {
+              elog( "market tick: %1%", boost::diagnostic_information(e) );
+            } catch ( const std::exception& e ) {
+              elog( "market tick: %1%", boost::diagnostic_information(e) );
+            }
+            next_tick = t + m_tick_ms;
+            continue;
+          }
+
+          scoped_lock lock(m_mutex);
+          m_sleeping.store( true );
+          boost::atomic_thread_fence( boost::memory_order_seq_cst );
+          if( !m_queue.read_available() )
+            m_wake.timed_wait( lock, boost::posix_time::milliseconds( next_tick - t ) );
+          m_sleeping.store( false );
+        }
+      }
+
+      static long long now() {
+        return to_milliseconds( to_ptime( system_clock::now() ) );
+      }
+
+      boost::lockfree::spsc_queue< command*, boost::lockfree::capacity<queue_size> > m_queue;
+      boost::mutex              m_post_mutex; // serializes the producers of m_queue
+
+      uint32_t                  m_tick_ms;
+      boost::atomic<bool>       m_sleeping;
+      boost::mutex              m_mutex;
+      boost::condition_variable m_wake;
+      boost::thread             m_thread;
+  };
+
+  class matching_engine_private {
+    public:
+      ~matching_engine_private() {
+        for( uint32_t i = 0; i < shards.size(); ++i )
+          delete shards[i];
+      }
+      std::vector<shard*> shards;
+      note_links          links;
+  };
+
+  /**
+   *  Recovers the books from the newest journal generation if there is
+   *  one and from the market_order rows otherwise.  Every shard then
+   *  snapshots its books into a new generation, which becomes current
+   *  before any worker starts.
+   */
+  matching_engine::matching_engine( dbo::Session& s, market_writer& w, uint32_t count,
+                                    const boost::filesystem::path& journal_dir,
+                                    const note_links& links, funds_ledger* ledger, market_feed* feed,
+                                    uint32_t tick_ms ) {
+    my = new matching_engine_private();
+    my->links = links;
+    if( count == 0 )
+      count = 1;
+
+    uint64_t gen = order_journal::current_generation( journal_dir );
+    std::vector< std::vector<order_entry> > recovered( count );
+    std::vector<std::string>                redo;
+    if( gen ) {
+      std::vector<order_entry> orders;
+      order_journal::replay( journal_dir, gen, orders, redo );
+      for( uint32_t i = 0; i < orders.size(); ++i )
+        recovered[ market::shard_of( orders[i].stock_note, orders[i].cur_note, count, &my->links ) ].push_back( orders[i] );
+    }
+
+    for( uint32_t i = 0; i < count; ++i ) {
+      my->shards.push_back( new shard( s, w, i, count, tick_ms, journal_dir, gen + 1, my->links, ledger, feed ) );
+      if( gen )
+        my->shards[i]->mark.load_orders( recovered[i] );
+      else
+        my->shards[i]->mark.load_books();
+      // the writer is shared, one shard carries the changes it may have missed
+      if( i == 0 && redo.size() )
+        my->shards[i]->mark.redo( redo );
+      my->shards[i]->mark.write_snapshot();
+    }
+    order_journal::set_current( journal_dir, gen + 1 );
+
+    for( uint32_t i = 0; i < count; ++i )
+      my->shards[i]->start();
+    slog( "matching on %1% shards", count );
+  }
+
+  matching_engine::~matching_engine() {
+    delete my;
+  }
+
+  uint32_t matching_engine::shard_count()const {
+    return my->shards.size();
+  }
+
+  uint32_t matching_engine::shard_of( const std::string& stock_note, const std::string& cur_note )const {
+    return market::shard_of( stock_note, cur_note, my->shards.size(), &my->links );
+  }
+
+  market& matching_engine::get_market( uint32_t s ) {
+    return my->shards.at(s)->mark;
+  }
+
+  void matching_engine::post( uint32_t s, const boost::function<void()>& cmd ) {
+    my->shards.at(s)->post( new command(cmd) );
+  }
+
+  static void submit_entry( market& m, const order_entry& e ) {
+    m.submit_order( e );
+  }
+
+  boost::unique_future<void> matching_engine::submit_order( const market_order::ptr& order ) {
+    order_entry e = market::make_entry( order );
+    return execute<void>( e.stock_note, e.cur_note, boost::bind( &submit_entry, _1, e ) );
+  }
+
+} // namespace ltl
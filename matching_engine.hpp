@@ -0,0 +1,93 @@
+#ifndef _LTL_MATCHING_ENGINE_HPP_
+#define _LTL_MATCHING_ENGINE_HPP_
+#include <ltl/market.hpp>
+#include <ltl/note_links.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/future.hpp>
+#include <vector>
+
+namespace ltl {
+
+  class market_writer;
+  class funds_ledger;
+  class market_feed;
+
+  /**
+   *  Runs matching for many pairs in parallel.
+   *
+   *  Every (stock_note, cur_note) pair is assigned to one of a fixed number
+   *  of shards by market::shard_of().  Each shard is a market holding only
+   *  its own pairs and driven by its own worker thread, so unrelated pairs
+   *  never wait for each other.  Work is handed to a shard through a
+   *  lock-free single producer/single consumer queue and results come back
+   *  as futures.  Each worker also ticks its market every tick_ms.
+   *
+   *  Pairs quoted in linked notes share a shard so that their market can
+   *  match through implied liquidity, the links are fixed for the life
+   *  of the engine.
+   *
+   *  Each shard journals its open orders (see order_journal), on start
+   *  the books are rebuilt from the journals instead of the database
+   *  once a journal exists.
+   *
+   *  Calls may come from any thread, the producers of a shard's queue
+   *  take turns under a lock of the shard that is held only to push.
+   *  Commands from one thread run in the order they were posted.
+   */
+  class matching_engine {
+    public:
+      /**
+       *  Loads the books of every shard before any worker starts, the
+       *  workers never use s.  ledger and feed, if given, must outlive
+       *  the engine and are shared by every shard.
+       */
+      matching_engine( dbo::Session& s, market_writer& w, uint32_t shards,
+                       const boost::filesystem::path& journal_dir,
+                       const note_links& links = note_links(), funds_ledger* ledger = 0,
+                       market_feed* feed = 0, uint32_t tick_ms = 100 );
+      ~matching_engine();
+
+      uint32_t shard_count()const;
+      uint32_t shard_of( const std::string& stock_note, const std::string& cur_note )const;
+
+      /**
+       *  Queues the order on the shard of its pair.  The market_order row
+       *  must already have been committed, the market writer loads it to
+       *  record the fills.  order is read on the calling thread.
+       */
+      boost::unique_future<void> submit_order( const market_order::ptr& order );
+
+      /**
+       *  Runs f( market ) on the worker of shard and returns its result.
+       */
+      template<typename R>
+      boost::unique_future<R> execute( uint32_t shard, const boost::function<R(market&)>& f ) {
+        boost::shared_ptr< boost::packaged_task<R> > task(
+            new boost::packaged_task<R>( boost::bind( f, boost::ref( get_market(shard) ) ) ) );
+        boost::unique_future<R> r = task->get_future();
+        post( shard, boost::bind( &boost::packaged_task<R>::operator(), task ) );
+        return r;
+      }
+
+      /**
+       *  Runs f on the shard that owns the pair.
+       */
+      template<typename R>
+      boost::unique_future<R> execute( const std::string& stock_note, const std::string& cur_note,
+                                       const boost::function<R(market&)>& f ) {
+        return execute<R>( shard_of( stock_note, cur_note ), f );
+      }
+
+    private:
+      market& get_market( uint32_t shard );
+      void    post( uint32_t shard, const boost::function<void()>& cmd );
+
+      class matching_engine_private* my;
+  };
+
+} // namespace ltl
+
+#endif
@@ -0,0 +1,45 @@
+#include <ltl/note_links.hpp>
+#include <algorithm>
+
+namespace ltl {
+
+  void note_links::link( const std::string& a, const std::string& b ) {
+    if( a == b )
+      return;
+    std::string ga = group( a );
+    std::string gb = group( b );
+    if( ga == gb )
+      return;
+
+    if( !is_linked( ga ) ) { m_members[ga].push_back( ga ); m_group[ga] = ga; }
+    if( !is_linked( gb ) ) { m_members[gb].push_back( gb ); m_group[gb] = gb; }
+
+    // fold the smaller group into the larger one
+    if( m_members[ga].size() < m_members[gb].size() )
+      std::swap( ga, gb );
+    std::vector<std::string>& ma = m_members[ga];
+    std::vector<std::string>& mb = m_members[gb];
+    for( uint32_t i = 0; i < mb.size(); ++i )
+      m_group[mb[i]] = ga;
+    ma.insert( ma.end(), mb.begin(), mb.end() );
+    m_members.erase( gb );
+  }
+
+  bool note_links::is_linked( const std::string& note )const {
+    return m_group.find( note ) != m_group.end();
+  }
+
+  const std::string& note_links::group( const std::string& note )const {
+    group_map::const_iterator itr = m_group.find( note );
+    return itr == m_group.end() ? note : itr->second;
+  }
+
+  const std::vector<std::string>& note_links::members( const std::string& note )const {
+    static const std::vector<std::string> none;
+    group_map::const_iterator itr = m_group.find( note );
+    if( itr == m_group.end() )
+      return none;
+    return m_members.find( itr->second )->second;
+  }
+
+} // namespace ltl
@@ -0,0 +1,46 @@
+#ifndef _LTL_NOTE_LINKS_HPP_
+#define _LTL_NOTE_LINKS_HPP_
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+namespace ltl {
+
+  /**
+   *  Groups of asset notes that stand for the same underlying asset, for
+   *  example the dollar notes of several issuers.  A pair quoted in a
+   *  linked note may be matched through the pairs quoted in the other
+   *  notes of its group, see market.
+   *
+   *  Linking is transitive.  A set of links is built once and is only
+   *  read afterwards, so it may be shared by every shard of an engine.
+   */
+  class note_links {
+    public:
+      void link( const std::string& a, const std::string& b );
+
+      bool               is_linked( const std::string& note )const;
+
+      /**
+       *  @return the note that names the group of note, note itself if it
+       *          is not linked.  Every note of a group returns the same one.
+       */
+      const std::string& group( const std::string& note )const;
+
+      /**
+       *  @return every note of the group of note including note, empty if
+       *          note is not linked.
+       */
+      const std::vector<std::string>& members( const std::string& note )const;
+
+    private:
+      typedef boost::unordered_map<std::string, std::string>              group_map;
+      typedef boost::unordered_map<std::string, std::vector<std::string> > member_map;
+
+      group_map  m_group;   // note -> name of its group, linked notes only
+      member_map m_members; // name of group -> notes
+  };
+
+} // namespace ltl
+
+#endif
@@ -0,0 +1,29 @@
+#include <ltl/note_table.hpp>
+
+namespace ltl {
+
+  note_table::note_table()
+  :m_names(1) {
+  }
+
+  uint32_t note_table::intern( const std::string& note ) {
+    uint32_t& h = m_handles[note];
+    if( !h ) {
+      h = m_names.size();
+      m_names.push_back( note );
+    }
+    return h;
+  }
+
+  uint32_t note_table::find( const std::string& note )const {
+    boost::unordered_map<std::string, uint32_t>::const_iterator itr = m_handles.find( note );
+    return itr == m_handles.end() ? uint32_t(none) : itr->second;
+  }
+
+  pair_key note_table::find_pair( const std::string& stock_note, const std::string& cur_note )const {
+    uint32_t s = find( stock_note );
+    uint32_t c = s ? find( cur_note ) : uint32_t(none);
+    return c ? make_pair_key( s, c ) : 0;
+  }
+
+} // namespace ltl
@@ -0,0 +1,55 @@
+#ifndef _LTL_NOTE_TABLE_HPP_
+#define _LTL_NOTE_TABLE_HPP_
+#include <boost/unordered_map.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ltl {
+
+  /**
+   *  A (stock_note, cur_note) pair as one integer, the stock handle in
+   *  the high half and the currency handle in the low half.
+   */
+  typedef uint64_t pair_key;
+
+  inline pair_key make_pair_key( uint32_t stock, uint32_t cur ) { return (pair_key(stock) << 32) | cur; }
+  inline uint32_t stock_of( pair_key k )                         { return uint32_t( k >> 32 ); }
+  inline uint32_t cur_of( pair_key k )                           { return uint32_t( k );       }
+
+  /**
+   *  Maps asset_note ids to dense 32 bit handles so that books, channels
+   *  and their indexes compare integers instead of hex ids.  Handles are
+   *  given out from 1 in the order notes are first seen and are only
+   *  meaningful to the table that gave them out.
+   *
+   *  Not thread safe, every market owns its own table.
+   */
+  class note_table {
+    public:
+      enum { none = 0 };
+
+      note_table();
+
+      /// @return the handle of note, adding it if it is new
+      uint32_t           intern( const std::string& note );
+
+      /// @return the handle of note or none if it was never interned
+      uint32_t           find( const std::string& note )const;
+
+      const std::string& name( uint32_t handle )const { return m_names[handle]; }
+
+      /// the largest handle given out so far
+      uint32_t           size()const { return m_names.size() - 1; }
+
+      /// @return the key of the pair or 0 if either note is unknown
+      pair_key           find_pair( const std::string& stock_note, const std::string& cur_note )const;
+
+    private:
+      boost::unordered_map<std::string, uint32_t> m_handles;
+      std::vector<std::string>                    m_names;  // by handle, m_names[none] is empty
+  };
+
+} // namespace ltl
+
+#endif
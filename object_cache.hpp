@@ -0,0 +1,151 @@
+#ifndef _LTL_OBJECT_CACHE_HPP_
+#define _LTL_OBJECT_CACHE_HPP_
+#include <ltl/dbo_traits.hpp>
+#include <ltl/crypto.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <list>
+#include <vector>
+
+namespace ltl {
+
+  /**
+   *  Counters of one object_cache, hits / (hits + misses) is its hit rate.
+   */
+  struct object_cache_stats {
+    object_cache_stats():hits(0),misses(0),evictions(0),invalidations(0),size(0),capacity(0){}
+
+    std::string kind;
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    evictions;
+    uint64_t    invalidations; // stale entries reread on their next hit
+    uint32_t    size;
+    uint32_t    capacity;
+  };
+
+  struct sha1_hash {
+    size_t operator()( const sha1& s )const { return s.hash[0]; }
+  };
+
+  /**
+   *  Bounded LRU of loaded objects keyed by their binary id.
+   *
+   *  An entry keeps its object loaded in the session along with whatever
+   *  it has decoded on demand (keys, signatures, its binary id), so a hit
+   *  costs neither a query nor base64 decoding.  Objects whose rows are
+   *  changed by other sessions are invalidate()d; the next hit rereads
+   *  them instead of returning the stale copy.
+   *
+   *  find() and insert() must be called with the lock of the session that
+   *  loaded the objects held, dbo::ptr is not thread safe.  invalidate()
+   *  may be called from any thread.
+   */
+  template<typename T>
+  class object_cache {
+    public:
+      typedef dbo::ptr<T> ptr;
+
+      object_cache( const std::string& kind, uint32_t capacity )
+      :m_capacity(capacity),m_stale_count(0) {
+        m_stats.kind     = kind;
+        m_stats.capacity = capacity;
+      }
+
+      /**
+       *  Moves the object to the front.  Must be called within a
+       *  transaction of the session, a stale object is reread.
+       *
+       *  @return a null ptr if the object is not cached
+       */
+      ptr find( const sha1& id ) {
+        if( m_stale_count.load( boost::memory_order_acquire ) )
+          take_stale();
+        typename index::iterator itr = m_index.find( id );
+        if( itr == m_index.end() ) {
+          ++m_stats.misses;
+          return ptr();
+        }
+        ++m_stats.hits;
+        m_lru.splice( m_lru.begin(), m_lru, itr->second );
+        entry& e = *itr->second;
+        if( e.stale ) {
+          e.obj.reread();
+          *e.obj; // load it now, the caller may use it outside of a transaction
+          e.stale = false;
+        }
+        return e.obj;
+      }
+
+      void insert( const sha1& id, const ptr& obj ) {
+        typename index::iterator itr = m_index.find( id );
+        if( itr != m_index.end() ) {
+          itr->second->obj   = obj;
+          itr->second->stale = false;
+          m_lru.splice( m_lru.begin(), m_lru, itr->second );
+          return;
+        }
+        m_lru.push_front( entry( id, obj ) );
+        m_index[id] = m_lru.begin();
+        if( m_index.size() > m_capacity ) {
+          m_index.erase( m_lru.back().id );
+          m_lru.pop_back();
+          ++m_stats.evictions;
+        }
+      }
+
+      /**
+       *  Marks the objects stale, they are reread on their next hit.
+       */
+      void invalidate( const std::vector<sha1>& ids ) {
+        boost::mutex::scoped_lock lock(m_stale_mutex);
+        m_stale.insert( m_stale.end(), ids.begin(), ids.end() );
+        m_stale_count.store( m_stale.size(), boost::memory_order_release );
+      }
+
+      object_cache_stats stats()const {
+        object_cache_stats s = m_stats;
+        s.size = m_index.size();
+        return s;
+      }
+
+    private:
+      struct entry {
+        entry( const sha1& i, const ptr& o ):id(i),obj(o),stale(false){}
+        sha1 id;
+        ptr  obj;
+        bool stale;
+      };
+      typedef std::list<entry>                                                   lru_list;
+      typedef boost::unordered_map<sha1, typename lru_list::iterator, sha1_hash> index;
+
+      void take_stale() {
+        std::vector<sha1> ids;
+        {
+          boost::mutex::scoped_lock lock(m_stale_mutex);
+          ids.swap( m_stale );
+          m_stale_count.store( 0, boost::memory_order_relaxed );
+        }
+        for( uint32_t i = 0; i < ids.size(); ++i ) {
+          typename index::iterator itr = m_index.find( ids[i] );
+          if( itr != m_index.end() && !itr->second->stale ) {
+            itr->second->stale = true;
+            ++m_stats.invalidations;
+          }
+        }
+      }
+
+      uint32_t                m_capacity;
+      lru_list                m_lru;         // most recently used first
+      index                   m_index;
+      object_cache_stats      m_stats;
+
+      boost::mutex            m_stale_mutex;
+      std::vector<sha1>       m_stale;       // invalidated since the last find
+      boost::atomic<uint32_t> m_stale_count; // m_stale.size(), read without the lock
+  };
+
+} // namespace ltl
+
+#endif
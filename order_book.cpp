@@ -0,0 +1,661 @@
+#include <ltl/order_book.hpp>
+#include <ltl/order_pool.hpp>
+#include <ltl/market_feed.hpp>
+#include <ltl/error.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+namespace ltl {
+
+struct free_order {
+  free_order( order_pool& p ):pool(p){}
+  void operator()( book_order* o )const { pool.free( o ); }
+  order_pool& pool;
+};
+
+order_book::order_book( const std::string& sn, const std::string& cn, uint32_t pair, order_pool& pool,
+                        pair_key key )
+:m_stock_note(sn),m_cur_note(cn),m_pair(pair),m_key(key),m_pool(pool),m_bid_ladder(true),m_ask_ladder(false),m_last_clear(0),m_last_price(0),m_depth_seq(0),m_channel(0) {
+}
+
+order_book::~order_book() {
+  for( bid_levels::iterator itr = m_bids.begin(); itr != m_bids.end(); ++itr )
+    itr->second.orders.clear_and_dispose( free_order(m_pool) );
+  for( ask_levels::iterator itr = m_asks.begin(); itr != m_asks.end(); ++itr )
+    itr->second.orders.clear_and_dispose( free_order(m_pool) );
+  for( buy_stop_levels::iterator itr = m_buy_stops.begin(); itr != m_buy_stops.end(); ++itr )
+    itr->second.clear_and_dispose( free_order(m_pool) );
+  for( sell_stop_levels::iterator itr = m_sell_stops.begin(); itr != m_sell_stops.end(); ++itr )
+    itr->second.clear_and_dispose( free_order(m_pool) );
+}
+
+/**
+ *  A trade must be at least the min_unit of both sides unless it
+ *  completes the remainder of one of them.
+ */
+static long long fill_amount( const book_order& o, const book_order& r ) {
+  long long n = (std::min)( o.num_unfilled, r.num_unfilled );
+  if( n < o.min_unit && n != o.num_unfilled ) return 0;
+  if( n < r.min_unit && n != r.num_unfilled ) return 0;
+  return n;
+}
+
+/**
+ *  The smallest resting quantity that can trade with o, anything less
+ *  is below o's min_unit without completing o.
+ */
+static long long min_resting( const book_order& o ) {
+  return (std::max)( 1LL, (std::min)( o.min_unit, o.num_unfilled ) );
+}
+
+/**
+ *  @return the level at price, created if the side has none
+ */
+template<typename Levels>
+price_level& order_book::level_for( Levels& lvls, long long price ) {
+  price_ladder& ladder = ladder_of( lvls );
+  if( !ladder.enabled() )
+    return lvls[price];
+  if( !ladder.covers( price ) ) {
+    LTL_THROW( "Price %1% is outside the tick range of %2%/%3%", %price %m_stock_note %m_cur_note );
+  }
+  if( price_level* lvl = ladder.at( price ) )
+    return *lvl;
+  price_level& lvl = lvls[price];
+  ladder.set( price, &lvl );
+  return lvl;
+}
+
+template<typename Levels>
+price_level& order_book::level_at( Levels& lvls, long long price ) {
+  price_ladder& ladder = ladder_of( lvls );
+  return ladder.enabled() ? *ladder.at( price ) : lvls.find( price )->second;
+}
+
+template<typename Levels>
+void order_book::erase_level( Levels& lvls, typename Levels::iterator itr ) {
+  price_ladder& ladder = ladder_of( lvls );
+  if( ladder.enabled() )
+    ladder.clear( itr->first );
+  lvls.erase( itr );
+}
+
+template<typename Levels>
+void order_book::erase_level( Levels& lvls, long long price ) {
+  price_ladder& ladder = ladder_of( lvls );
+  if( ladder.enabled() )
+    ladder.clear( price );
+  lvls.erase( price );
+}
+
+/**
+ *  Crosses o against lvls until a level no longer accepts limit.  Trades
+ *  happen at the resting level's price unless trade_price is given.
+ */
+template<typename Levels>
+void order_book::match_levels( Levels& lvls, book_order& o, long long limit, long long trade_price,
+                               long long now, std::vector<book_fill>& fills ) {
+  // key_comp() orders levels best first, so the level crosses o until limit sorts before it
+  const price_ladder& ladder = ladder_of( lvls );
+  if( ladder.enabled() ) {
+    long long price;
+    bool      more = ladder.best( price );
+    while( more && o.num_unfilled > 0 && !lvls.key_comp()( limit, price ) ) {
+      price_level& lvl = *ladder.at( price );
+      cross_level( lvl, price, o, trade_price, now, fills );
+      if( lvl.orders.empty() )
+        erase_level( lvls, price );
+      more = ladder.next( price, price );
+    }
+    return;
+  }
+
+  typename Levels::iterator litr = lvls.begin();
+  while( litr != lvls.end() && o.num_unfilled > 0 && !lvls.key_comp()( limit, litr->first ) ) {
+    cross_level( litr->second, litr->first, o, trade_price, now, fills );
+    if( litr->second.orders.empty() )
+      lvls.erase(litr++);
+    else
+      ++litr;
+  }
+}
+
+/**
+ *  Crosses o against the orders of lvl, which rests at price.
+ */
+void order_book::cross_level( price_level& lvl, long long price, book_order& o, long long trade_price,
+                              long long now, std::vector<book_fill>& fills ) {
+  long long total = lvl.total;
+
+  // only orders that reach o's min_unit are visited, FIFO among them
+  book_order* r = lvl.index.find( 0, min_resting( o ) );
+  while( r && o.num_unfilled > 0 ) {
+    uint32_t  next = r->level_pos + 1;
+    long long n    = fill_amount( o, *r );
+    if( n == 0 ) {
+      r = lvl.index.find( next, min_resting( o ) );
+      continue;
+    }
+    trade( lvl, *r, o, n, trade_price ? trade_price : price, now, fills );
+    r = o.num_unfilled > 0 ? lvl.index.find( next, min_resting( o ) ) : 0;
+  }
+
+  if( lvl.total != total )
+    publish_level( o.type == market_order::buy ? market_order::sell : market_order::buy, price, lvl );
+}
+
+/**
+ *  Trades n between r, which rests in lvl, and o.  r is disposed of if
+ *  it has been filled completely.
+ */
+void order_book::trade( price_level& lvl, book_order& r, book_order& o, long long n, long long price,
+                        long long now, std::vector<book_fill>& fills ) {
+  o.num_unfilled -= n;
+  r.num_unfilled -= n;
+  lvl.total      -= n;
+
+  const book_order& b = o.type == market_order::buy ? o : r;
+  const book_order& s = o.type == market_order::buy ? r : o;
+  book_fill f;
+  f.buy           = b.slot;
+  f.sell          = s.slot;
+  f.buy_unfilled  = b.num_unfilled;
+  f.sell_unfilled = s.num_unfilled;
+  f.num           = n;
+  f.price         = price;
+  f.implied       = 0;
+  f.bridge        = false;
+  fills.push_back(f);
+  m_tape.add( f.price, n, now );
+  m_last_price = f.price;
+
+  if( r.num_unfilled == 0 ) {
+    lvl.index.erase( r );
+    lvl.orders.erase_and_dispose( lvl.orders.iterator_to( r ), free_order(m_pool) );
+  } else {
+    lvl.index.update( r );
+  }
+}
+
+void order_book::match( book_order& o, long long now, std::vector<book_fill>& fills ) {
+  match( o, o.price, now, fills );
+}
+
+void order_book::match( book_order& o, long long limit, long long now, std::vector<book_fill>& fills ) {
+  if( o.type == market_order::buy )
+    match_levels( m_asks, o, limit, 0, now, fills );
+  else
+    match_levels( m_bids, o, limit, 0, now, fills );
+  update_quote();
+}
+
+template<typename Levels>
+void order_book::fill_from( Levels& lvls, book_order& r, book_order& o, long long n,
+                            long long now, std::vector<book_fill>& fills ) {
+  long long    price = r.price;
+  price_level& lvl   = level_at( lvls, price );
+  int          side  = r.type; // r is gone if it has been filled
+  trade( lvl, r, o, n, price, now, fills );
+  publish_level( side, price, lvl );
+  if( lvl.orders.empty() )
+    erase_level( lvls, price );
+}
+
+void order_book::fill( book_order& r, book_order& o, long long n, long long now, std::vector<book_fill>& fills ) {
+  if( r.type == market_order::buy )
+    fill_from( m_bids, r, o, n, now, fills );
+  else
+    fill_from( m_asks, r, o, n, now, fills );
+  update_quote();
+}
+
+long long order_book::clear_auction( long long now, std::vector<book_fill>& fills ) {
+  if( m_bids.empty() || m_asks.empty() || m_bids.begin()->first < m_asks.begin()->first )
+    return 0;
+
+  // every level price inside the crossed range is a candidate clearing price
+  std::vector<long long> prices;
+  for( bid_levels::iterator itr = m_bids.begin(); itr != m_bids.end() && itr->first >= m_asks.begin()->first; ++itr )
+    prices.push_back( itr->first );
+  for( ask_levels::iterator itr = m_asks.begin(); itr != m_asks.end() && itr->first <= m_bids.begin()->first; ++itr )
+    prices.push_back( itr->first );
+  std::sort( prices.begin(), prices.end() );
+  prices.erase( std::unique( prices.begin(), prices.end() ), prices.end() );
+
+  // demand[i] = bid quantity at prices[i] or better
+  std::vector<long long> demand( prices.size() );
+  bid_levels::iterator bitr = m_bids.begin();
+  long long cum = 0;
+  for( int i = int(prices.size()) - 1; i >= 0; --i ) {
+    for( ; bitr != m_bids.end() && bitr->first >= prices[i]; ++bitr )
+      cum += bitr->second.total;
+    demand[i] = cum;
+  }
+
+  // supply[i] = ask quantity at prices[i] or better
+  std::vector<long long> supply( prices.size() );
+  ask_levels::iterator aitr = m_asks.begin();
+  cum = 0;
+  for( uint32_t i = 0; i < prices.size(); ++i ) {
+    for( ; aitr != m_asks.end() && aitr->first <= prices[i]; ++aitr ) 
+      cum += aitr->second.total;
+    supply[i] = cum;
+  }
+
+  int       best     = -1;
+  long long best_vol = 0;
+  long long best_imb = 0;
+  for( uint32_t i = 0; i < prices.size(); ++i ) {
+    long long vol = (std::min)( demand[i], supply[i] );
+    long long imb = demand[i] > supply[i] ? demand[i] - supply[i] : supply[i] - demand[i];
+    if( vol == 0 ) continue;
+    bool better = best < 0 || vol > best_vol || ( vol == best_vol && imb < best_imb );
+    if( !better && vol == best_vol && imb == best_imb && m_last_clear ) {
+      better = std::abs( prices[i] - m_last_clear ) < std::abs( prices[best] - m_last_clear );
+    }
+    if( better ) {
+      best     = i;
+      best_vol = vol;
+      best_imb = imb;
+    }
+  }
+  if( best < 0 )
+    return 0;
+
+  long long price = prices[best];
+
+  // cross the bids that accept the clearing price in priority order
+  bid_levels::iterator litr = m_bids.begin();
+  while( litr != m_bids.end() && litr->first >= price ) {
+    price_level& lvl   = litr->second;
+    long long    total = lvl.total;
+    order_queue::iterator oitr = lvl.orders.begin();
+    while( oitr != lvl.orders.end() ) {
+      long long before = oitr->num_unfilled;
+      match_levels( m_asks, *oitr, price, price, now, fills );
+      lvl.total -= before - oitr->num_unfilled;
+      if( oitr->num_unfilled == 0 ) {
+        lvl.index.erase( *oitr );
+        oitr = lvl.orders.erase_and_dispose( oitr, free_order(m_pool) );
+      } else {
+        if( oitr->num_unfilled != before )
+          lvl.index.update( *oitr );
+        ++oitr;
+      }
+    }
+    if( lvl.total != total )
+      publish_level( market_order::buy, litr->first, lvl );
+    if( lvl.orders.empty() )
+      erase_level( m_bids, litr++ );
+    else
+      ++litr;
+  }
+
+  m_last_clear = price;
+  update_quote();
+  return price;
+}
+
+void order_book::insert( book_order* o ) {
+  o->state = book_order::resting;
+  price_level& lvl = o->type == market_order::buy ? level_for( m_bids, o->price ) : level_for( m_asks, o->price );
+  lvl.orders.push_back(*o);
+  lvl.index.push_back(*o);
+  lvl.total += o->num_unfilled;
+  publish_level( o->type, o->price, lvl );
+  update_quote();
+}
+
+template<typename Levels>
+void order_book::unlink_from( Levels& lvls, book_order& o ) {
+  price_level& lvl = level_at( lvls, o.price );
+  lvl.total -= o.num_unfilled;
+  lvl.index.erase( o );
+  lvl.orders.erase( lvl.orders.iterator_to(o) );
+  publish_level( o.type, o.price, lvl );
+  if( lvl.orders.empty() )
+    erase_level( lvls, o.price );
+}
+
+template<typename Levels>
+void order_book::reduce_in( Levels& lvls, book_order& o, long long num_unfilled ) {
+  price_level& lvl = level_at( lvls, o.price );
+  lvl.total     -= o.num_unfilled - num_unfilled;
+  o.num_unfilled = num_unfilled;
+  lvl.index.update( o );
+  publish_level( o.type, o.price, lvl );
+}
+
+template<typename Stops>
+void order_book::remove_stop( Stops& stops, book_order& o ) {
+  typename Stops::iterator sitr = stops.find( o.stop_price );
+  sitr->second.erase_and_dispose( sitr->second.iterator_to(o), free_order(m_pool) );
+  if( sitr->second.empty() )
+    stops.erase( sitr );
+}
+
+void order_book::remove( book_order& o ) {
+  if( o.state == book_order::stopped ) {
+    if( o.type == market_order::buy )
+      remove_stop( m_buy_stops, o );
+    else
+      remove_stop( m_sell_stops, o );
+  } else {
+    unlink( o );
+    m_pool.free( &o );
+  }
+}
+
+void order_book::unlink( book_order& o ) {
+  if( o.type == market_order::buy )
+    unlink_from( m_bids, o );
+  else
+    unlink_from( m_asks, o );
+  update_quote();
+}
+
+void order_book::reduce( book_order& o, long long num_unfilled ) {
+  if( o.state == book_order::stopped ) {
+    o.num_unfilled = num_unfilled;
+    return;
+  }
+  if( o.type == market_order::buy )
+    reduce_in( m_bids, o, num_unfilled );
+  else
+    reduce_in( m_asks, o, num_unfilled );
+  update_quote();
+}
+
+void order_book::set_tick_range( long long lo, long long hi ) {
+  uint32_t ticks = 0;
+  if( hi ) {
+    if( lo <= 0 || hi < lo || hi - lo >= price_ladder::max_ticks ) {
+      LTL_THROW( "Invalid tick range %1% .. %2%, at most %3% ticks are supported", %lo %hi %price_ladder::max_ticks );
+    }
+    bool outside = ( !m_bids.empty() && ( m_bids.rbegin()->first < lo || m_bids.begin()->first > hi ) ) ||
+                   ( !m_asks.empty() && ( m_asks.begin()->first < lo || m_asks.rbegin()->first > hi ) );
+    if( outside ) {
+      LTL_THROW( "Orders of %1%/%2% rest outside the tick range %3% .. %4%", %m_stock_note %m_cur_note %lo %hi );
+    }
+    ticks = hi - lo + 1;
+  }
+  m_bid_ladder.reset( lo, ticks );
+  m_ask_ladder.reset( lo, ticks );
+  if( !ticks )
+    return;
+  for( bid_levels::iterator itr = m_bids.begin(); itr != m_bids.end(); ++itr )
+    m_bid_ladder.set( itr->first, &itr->second );
+  for( ask_levels::iterator itr = m_asks.begin(); itr != m_asks.end(); ++itr )
+    m_ask_ladder.set( itr->first, &itr->second );
+}
+
+book_order* order_book::front( int side ) {
+  if( side == market_order::buy )
+    return m_bids.empty() ? 0 : &m_bids.begin()->second.orders.front();
+  return m_asks.empty() ? 0 : &m_asks.begin()->second.orders.front();
+}
+
+bool order_book::stop_triggered( const book_order& o )const {
+  if( !m_last_price )
+    return false;
+  return o.type == market_order::buy ? m_last_price >= o.stop_price : m_last_price <= o.stop_price;
+}
+
+void order_book::arm( book_order* o ) {
+  o->state = book_order::stopped;
+  if( o->type == market_order::buy )
+    m_buy_stops[o->stop_price].push_back(*o);
+  else
+    m_sell_stops[o->stop_price].push_back(*o);
+}
+
+template<typename Stops>
+book_order* order_book::pop_stop( Stops& stops ) {
+  typename Stops::iterator sitr = stops.begin();
+  book_order* o = &sitr->second.front();
+  sitr->second.pop_front();
+  if( sitr->second.empty() )
+    stops.erase( sitr );
+  return o;
+}
+
+book_order* order_book::pop_triggered() {
+  if( !m_last_price )
+    return 0;
+  if( !m_buy_stops.empty() && m_buy_stops.begin()->first <= m_last_price )
+    return pop_stop( m_buy_stops );
+  if( !m_sell_stops.empty() && m_sell_stops.begin()->first >= m_last_price )
+    return pop_stop( m_sell_stops );
+  return 0;
+}
+
+void quantity_index::push_back( book_order& o ) {
+  if( m_size == m_cap )
+    rebuild();
+  o.level_pos          = m_size++;
+  m_orders[o.level_pos] = &o;
+  ++m_live;
+  update( o );
+}
+
+void quantity_index::update( const book_order& o ) {
+  uint32_t i = m_cap + o.level_pos;
+  m_tree[i] = o.num_unfilled;
+  for( i /= 2; i > 0; i /= 2 )
+    m_tree[i] = (std::max)( m_tree[2*i], m_tree[2*i+1] );
+}
+
+void quantity_index::erase( const book_order& o ) {
+  m_orders[o.level_pos] = 0;
+  uint32_t i = m_cap + o.level_pos;
+  m_tree[i] = 0;
+  for( i /= 2; i > 0; i /= 2 )
+    m_tree[i] = (std::max)( m_tree[2*i], m_tree[2*i+1] );
+  if( --m_live == 0 )
+    m_size = 0;
+}
+
+/**
+ *  Renumbers the live orders from leaf 0 into a tree with room for at
+ *  least as many again.
+ */
+void quantity_index::rebuild() {
+  uint32_t cap = 16;
+  while( cap < 2 * ( m_live + 1 ) )
+    cap *= 2;
+
+  std::vector<long long>   tree( 2 * cap, 0 );
+  std::vector<book_order*> orders( cap, (book_order*)0 );
+  uint32_t n = 0;
+  for( uint32_t i = 0; i < m_size; ++i ) {
+    if( !m_orders[i] ) continue;
+    orders[n]            = m_orders[i];
+    orders[n]->level_pos = n;
+    tree[cap + n]        = orders[n]->num_unfilled;
+    ++n;
+  }
+  for( uint32_t i = cap - 1; i > 0; --i )
+    tree[i] = (std::max)( tree[2*i], tree[2*i+1] );
+
+  m_tree.swap( tree );
+  m_orders.swap( orders );
+  m_cap  = cap;
+  m_size = n;
+}
+
+book_order* quantity_index::find( uint32_t from, long long min )const {
+  if( from >= m_size )
+    return 0;
+  return find( 1, 0, m_cap, from, min );
+}
+
+book_order* quantity_index::find( uint32_t node, uint32_t lo, uint32_t hi, uint32_t from, long long min )const {
+  if( hi <= from || m_tree[node] < min )
+    return 0;
+  if( hi - lo == 1 )
+    return m_orders[lo];
+  uint32_t mid = ( lo + hi ) / 2;
+  if( book_order* o = find( 2*node, lo, mid, from, min ) )
+    return o;
+  return find( 2*node+1, mid, hi, from, min );
+}
+
+void price_ladder::reset( long long lo, uint32_t ticks ) {
+  m_lo    = lo;
+  m_ticks = ticks;
+  m_top   = 0;
+  uint32_t words = ( ticks + 63 ) / 64;
+  std::vector<uint64_t>( ( words + 63 ) / 64, 0 ).swap( m_mid );
+  std::vector<uint64_t>( words, 0 ).swap( m_bits );
+  std::vector<price_level*>( ticks, (price_level*)0 ).swap( m_levels );
+}
+
+void price_ladder::set( long long price, price_level* lvl ) {
+  uint32_t t = price - m_lo;
+  uint32_t w = t / 64;
+  m_levels[t]  = lvl;
+  m_bits[w]   |= 1ULL << ( t % 64 );
+  m_mid[w/64] |= 1ULL << ( w % 64 );
+  m_top       |= 1ULL << ( w / 64 );
+}
+
+void price_ladder::clear( long long price ) {
+  uint32_t t = price - m_lo;
+  uint32_t w = t / 64;
+  m_levels[t] = 0;
+  if( ( m_bits[w] &= ~( 1ULL << ( t % 64 ) ) ) )
+    return;
+  if( ( m_mid[w/64] &= ~( 1ULL << ( w % 64 ) ) ) )
+    return;
+  m_top &= ~( 1ULL << ( w / 64 ) );
+}
+
+bool price_ladder::best( long long& price )const {
+  uint32_t t;
+  if( !( m_high_first ? find_down( m_ticks - 1, t ) : find_up( 0, t ) ) )
+    return false;
+  price = m_lo + t;
+  return true;
+}
+
+bool price_ladder::next( long long after, long long& price )const {
+  uint32_t t = after - m_lo;
+  if( m_high_first ? ( t == 0 || !find_down( t - 1, t ) ) : !find_up( t + 1, t ) )
+    return false;
+  price = m_lo + t;
+  return true;
+}
+
+/**
+ *  Finds the lowest occupied tick at or above from.  A miss in the word
+ *  of from moves up to the summary layers, so at most three words are
+ *  scanned.
+ */
+bool price_ladder::find_up( uint32_t from, uint32_t& tick )const {
+  if( from >= m_ticks )
+    return false;
+  uint32_t w    = from / 64;
+  uint64_t bits = m_bits[w] & ( ~0ULL << ( from % 64 ) );
+  if( !bits ) {
+    uint32_t g     = w / 64;
+    uint64_t words = w % 64 == 63 ? 0 : m_mid[g] & ( ~0ULL << ( w % 64 + 1 ) );
+    if( !words ) {
+      uint64_t groups = g == 63 ? 0 : m_top & ( ~0ULL << ( g + 1 ) );
+      if( !groups )
+        return false;
+      g     = __builtin_ctzll( groups );
+      words = m_mid[g];
+    }
+    w    = g * 64 + __builtin_ctzll( words );
+    bits = m_bits[w];
+  }
+  tick = w * 64 + __builtin_ctzll( bits );
+  return true;
+}
+
+/**
+ *  Finds the highest occupied tick at or below from, which must be
+ *  covered.
+ */
+bool price_ladder::find_down( uint32_t from, uint32_t& tick )const {
+  uint32_t w    = from / 64;
+  uint64_t bits = m_bits[w] & ( ~0ULL >> ( 63 - from % 64 ) );
+  if( !bits ) {
+    uint32_t g     = w / 64;
+    uint64_t words = w % 64 == 0 ? 0 : m_mid[g] & ( ~0ULL >> ( 64 - w % 64 ) );
+    if( !words ) {
+      uint64_t groups = g == 0 ? 0 : m_top & ( ~0ULL >> ( 64 - g ) );
+      if( !groups )
+        return false;
+      g     = 63 - __builtin_clzll( groups );
+      words = m_mid[g];
+    }
+    w    = g * 64 + 63 - __builtin_clzll( words );
+    bits = m_bits[w];
+  }
+  tick = w * 64 + 63 - __builtin_clzll( bits );
+  return true;
+}
+
+void order_book::publish_level( int side, long long price, const price_level& lvl ) {
+  depth_delta d;
+  d.seq      = ++m_depth_seq;
+  d.side     = side;
+  d.price    = price;
+  d.quantity = lvl.total;
+  d.orders   = lvl.orders.size();
+  m_deltas.push_back(d);
+  if( m_deltas.size() > max_depth_history )
+    m_deltas.pop_front();
+  if( m_channel )
+    m_channel->publish( d );
+}
+
+/**
+ *  Publishes the best bid, best ask and last price if any of them
+ *  changed, called at the end of every operation that changes the book.
+ */
+void order_book::update_quote() {
+  if( !m_channel )
+    return;
+  book_quote q;
+  q.bid          = m_bids.empty() ? 0 : m_bids.begin()->first;
+  q.bid_quantity = m_bids.empty() ? 0 : m_bids.begin()->second.total;
+  q.ask          = m_asks.empty() ? 0 : m_asks.begin()->first;
+  q.ask_quantity = m_asks.empty() ? 0 : m_asks.begin()->second.total;
+  q.last_price   = m_last_price;
+  q.seq          = m_depth_seq;
+  m_channel->publish_quote( q );
+}
+
+template<typename Levels>
+static void copy_depth( const Levels& lvls, uint32_t max_levels, std::vector<depth_level>& out ) {
+  out.reserve( max_levels ? (std::min)( size_t(max_levels), lvls.size() ) : lvls.size() );
+  for( typename Levels::const_iterator itr = lvls.begin(); 
+       itr != lvls.end() && ( !max_levels || out.size() < max_levels ); ++itr ) {
+    depth_level dl;
+    dl.price    = itr->first;
+    dl.quantity = itr->second.total;
+    dl.orders   = itr->second.orders.size();
+    out.push_back(dl);
+  }
+}
+
+uint64_t order_book::get_depth( uint32_t max_levels, std::vector<depth_level>& bids, 
+                                                     std::vector<depth_level>& asks )const {
+  copy_depth( m_bids, max_levels, bids );
+  copy_depth( m_asks, max_levels, asks );
+  return m_depth_seq;
+}
+
+bool order_book::get_depth_deltas( uint64_t since_seq, std::vector<depth_delta>& deltas )const {
+  if( since_seq >= m_depth_seq )
+    return true;
+  if( m_deltas.empty() || m_deltas.front().seq > since_seq + 1 )
+    return false;
+  // sequence numbers are consecutive so the first delta wanted can be indexed directly
+  deltas.insert( deltas.end(), m_deltas.begin() + ( since_seq + 1 - m_deltas.front().seq ), m_deltas.end() );
+  return true;
+}
+
+} // namespace ltl
@@ -0,0 +1,456 @@
+#ifndef _LTL_ORDER_BOOK_HPP_
+#define _LTL_ORDER_BOOK_HPP_
+#include <ltl/market.hpp>
+#include <ltl/note_table.hpp>
+#include <ltl/timer_wheel.hpp>
+#include <ltl/trade_tape.hpp>
+#include <boost/intrusive/list.hpp>
+#include <boost/static_assert.hpp>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <map>
+
+namespace ltl {
+
+  class order_book;
+  class order_pool;
+  class feed_channel;
+
+  struct level_tag;
+  typedef boost::intrusive::list_base_hook< boost::intrusive::tag<level_tag> > level_hook;
+
+  struct owner_tag;
+  typedef boost::intrusive::list_base_hook< boost::intrusive::tag<owner_tag>,
+                                            boost::intrusive::link_mode<boost::intrusive::auto_unlink> > owner_hook;
+
+  /**
+   *  A self contained copy of an open order.  This is the form in which
+   *  orders are handed to the thread of a market and written to and
+   *  read back from its journal, the market keeps them as book_orders.
+   */
+  struct order_entry {
+    order_entry()
+    :type(0),price(0),num_unfilled(0),min_unit(0),stop_price(0),start_date(0),end_date(0){}
+
+    std::string        id;           // id of the order_trx, the key of the market_order row
+    std::string        owner;
+    std::string        stock_note;
+    std::string        cur_note;
+    int                type;
+    long long          price;
+    long long          num_unfilled;
+    long long          min_unit;
+    long long          stop_price;   // 0 for a limit order
+    std::string        funds_account; // account reserved from, see funds_ledger
+    long long          start_date;
+    long long          end_date;
+  };
+
+  /**
+   *  The resident state of an open order.  Matching reads and writes
+   *  only these records, the market_order row is brought up to date
+   *  after the book has been modified.  Orders hold no dbo::ptr so that
+   *  a book can be matched on a thread that does not own the session.
+   *
+   *  Records are fixed size and come from the market's order_pool.  The
+   *  pair and the owner are handles into tables of the market and the
+   *  id lives in the pool under the record's slot, so a record holds no
+   *  strings and fits in two cache lines.
+   *
+   *  An order is linked into the queue of its price level, or of its
+   *  stop price while it waits for a trigger, and, through its
+   *  timer_entry, into the market's timer wheel: at start_date while it
+   *  waits to become active and at end_date afterwards.  The start_date
+   *  is not kept, while it matters it is the time of the timer.  It is
+   *  also linked into the list of open orders of its owner.  Destroying
+   *  the order unlinks it from the wheel and the owner list.
+   */
+  struct book_order : public level_hook, public owner_hook, public timer_entry {
+    enum state_type {
+      pending = 0,  // waiting for start_date in the market's pending queue
+      stopped = 1,  // waiting in its book for a trade at stop_price
+      resting = 2   // in a price level of its book
+    };
+
+    book_order()
+    :price(0),num_unfilled(0),min_unit(0),stop_price(0),end_date(0),seq(0),
+     slot(0),pair(0),owner(0),level_pos(0),type(0),state(pending){}
+
+    long long          price;
+    long long          num_unfilled;
+    long long          min_unit;
+    long long          stop_price;   // 0 for a limit order or once the stop has triggered
+    long long          end_date;
+    uint64_t           seq;          // arrival order, FIFO tie breaker within a level
+    uint32_t           slot;         // position in the order_pool, also the key of the id
+    uint32_t           pair;         // handle of the (stock_note, cur_note) book
+    uint32_t           owner;        // handle of the owning identity
+    uint32_t           level_pos;    // leaf in the quantity_index of its level
+    uint8_t            type;
+    uint8_t            state;
+  };
+  BOOST_STATIC_ASSERT( sizeof(book_order) <= 128 );
+
+  /**
+   *  One trade produced by the book along with the quantity each side
+   *  has left after it.  Orders are named by their slot in the
+   *  order_pool, a side that was completely filled has been freed but
+   *  its id remains readable until the pool reclaims it.
+   */
+  struct book_fill {
+    uint32_t           buy;
+    uint32_t           sell;
+    long long          buy_unfilled;
+    long long          sell_unfilled;
+    long long          num;
+    long long          price;
+    int                implied;       // side that traded through an implied route, 0 if neither
+    bool               bridge;        // true for the bridge trade of that route, linked note for currency
+  };
+
+  /**
+   *  Aggregated resting quantity at one price.
+   */
+  struct depth_level {
+    long long price;
+    long long quantity;
+    uint32_t  orders;
+  };
+
+  /**
+   *  The new state of one price level after a change to the book.  A
+   *  quantity of 0 means the level has been removed.  Deltas carry
+   *  consecutive sequence numbers so a client holding a snapshot at
+   *  seq N can apply every delta after N to stay current.
+   */
+  struct depth_delta {
+    uint64_t  seq;
+    int       side;     // market_order::buy for bids, market_order::sell for asks
+    long long price;
+    long long quantity;
+    uint32_t  orders;
+  };
+
+  typedef boost::intrusive::list< book_order, boost::intrusive::base_hook<level_hook> > order_queue;
+
+  /**
+   *  Max tree over the num_unfilled of the orders of one level in arrival
+   *  order.  An order takes the next leaf when it joins the level and
+   *  keeps it until it leaves, the leaves of departed orders hold 0.
+   *
+   *  find() skips every order smaller than a minimum in O(log n), so an
+   *  order with a large min_unit is matched against a level crowded with
+   *  small orders without visiting them.  Leaves are renumbered when the
+   *  tree is full, never while a level is being matched.
+   */
+  class quantity_index {
+    public:
+      quantity_index():m_cap(0),m_size(0),m_live(0){}
+
+      /// gives o the next leaf, o must be the newest order of the level
+      void        push_back( book_order& o );
+      /// brings the leaf of o up to date after its num_unfilled changed
+      void        update( const book_order& o );
+      void        erase( const book_order& o );
+
+      /**
+       *  @return the first order at or after leaf from with at least min
+       *          unfilled, 0 if there is none.  min must be positive.
+       */
+      book_order* find( uint32_t from, long long min )const;
+
+    private:
+      void        rebuild();
+      book_order* find( uint32_t node, uint32_t lo, uint32_t hi, uint32_t from, long long min )const;
+
+      std::vector<long long>   m_tree;   // heap layout, the leaves are m_tree[m_cap..2*m_cap)
+      std::vector<book_order*> m_orders; // by leaf
+      uint32_t                 m_cap;
+      uint32_t                 m_size;   // leaves handed out
+      uint32_t                 m_live;
+  };
+
+  /**
+   *  All resting orders at one price in arrival order.  The level owns
+   *  the orders linked into it, they are returned to the book's pool.
+   */
+  struct price_level {
+    price_level():total(0){}
+
+    long long      total;  // sum of num_unfilled of all orders
+    order_queue    orders;
+    quantity_index index;
+  };
+
+  /**
+   *  Occupancy of the price levels of one side of a book whose prices
+   *  are bounded to a range of ticks.  Three layers of 64 bit words mark
+   *  the occupied ticks, the words holding an occupied tick and the
+   *  groups of words holding one, so the best level and the level after
+   *  any price are found with a few bit scans however sparse the side
+   *  is.  Levels are also reached by tick without searching the map they
+   *  live in.
+   */
+  class price_ladder {
+    public:
+      enum { max_ticks = 64*64*64 };
+
+      /// @param high_first true for bids, whose best level is the highest price
+      price_ladder( bool high_first ):m_high_first(high_first),m_lo(0),m_ticks(0),m_top(0){}
+
+      /// covers lo .. lo+ticks-1 and forgets every level, 0 ticks disables the ladder
+      void         reset( long long lo, uint32_t ticks );
+
+      bool         enabled()const                { return m_ticks != 0; }
+      bool         covers( long long price )const { return price >= m_lo && price - m_lo < m_ticks; }
+
+      /// the level at a covered price, 0 if it is empty
+      price_level* at( long long price )const    { return m_levels[price - m_lo]; }
+      void         set( long long price, price_level* lvl );
+      void         clear( long long price );
+
+      /// finds the best occupied price, false if the side is empty
+      bool         best( long long& price )const;
+      /// finds the best occupied price that is worse than after
+      bool         next( long long after, long long& price )const;
+
+    private:
+      bool         find_up( uint32_t from, uint32_t& tick )const;
+      bool         find_down( uint32_t from, uint32_t& tick )const;
+
+      bool                      m_high_first;
+      long long                 m_lo;
+      uint32_t                  m_ticks;
+      uint64_t                  m_top;    // bit g set if m_mid[g] is not 0
+      std::vector<uint64_t>     m_mid;    // bit w%64 of m_mid[w/64] set if m_bits[w] is not 0
+      std::vector<uint64_t>     m_bits;   // bit t%64 of m_bits[t/64] set if tick t is occupied
+      std::vector<price_level*> m_levels; // by tick
+  };
+
+  /**
+   *  In memory price-time priority book for one (stock_note, cur_note)
+   *  pair.  Bids are kept highest price first and asks lowest price
+   *  first so that the best level is always at begin().
+   *
+   *  Only active orders rest in the book, the market holds orders back
+   *  until their start_date and removes them at their end_date, so
+   *  matching never has to look at the dates.
+   *
+   *  Stop orders wait in a trigger table sorted by stop price, buy stops
+   *  lowest first and sell stops highest first, so the stops reached by
+   *  the last trade are always at begin().  The market takes them out
+   *  with pop_triggered() after every matching pass and matches them
+   *  like new orders.
+   */
+  class order_book {
+    public:
+      typedef std::map<long long, price_level, std::greater<long long> > bid_levels;
+      typedef std::map<long long, price_level, std::less<long long> >    ask_levels;
+      typedef std::map<long long, order_queue, std::less<long long> >    buy_stop_levels;
+      typedef std::map<long long, order_queue, std::greater<long long> > sell_stop_levels;
+
+      /**
+       *  @param pair the handle orders of this book carry
+       *  @param pool the pool the orders resting in the book come from
+       *  @param key  the notes of the pair in the owner's note_table
+       */
+      order_book( const std::string& stock_note, const std::string& cur_note, uint32_t pair, order_pool& pool,
+                  pair_key key = 0 );
+      ~order_book();
+
+      const std::string& stock_note()const { return m_stock_note; }
+      const std::string& cur_note()const   { return m_cur_note;   }
+      uint32_t           pair()const       { return m_pair;       }
+      pair_key           key()const        { return m_key;        }
+      uint32_t           stock()const      { return stock_of( m_key ); }
+      uint32_t           cur()const        { return cur_of( m_key );   }
+
+      /**
+       *  Bounds the prices of the book to lo .. hi so that both sides are
+       *  stepped through by a price_ladder instead of the level maps.  A
+       *  hi of 0 removes the bound.
+       *
+       *  @throw if the range is wider than price_ladder::max_ticks or an
+       *         order rests outside it
+       */
+      void set_tick_range( long long lo, long long hi );
+
+      /// @return false if the book is bounded and price lies outside the bound
+      bool accepts( long long price )const { return !m_bid_ladder.enabled() || m_bid_ladder.covers( price ); }
+
+      /**
+       *  Crosses o against the resting orders on the opposite side,
+       *  best price first and FIFO within a price.  Every trade is
+       *  appended to fills and o.num_unfilled is reduced accordingly.
+       *  Resting orders that are completely filled are removed.  Trades
+       *  are stamped with now (utc ms) on the tape.
+       */
+      void match( book_order& o, long long now, std::vector<book_fill>& fills );
+
+      /**
+       *  Like match() but only crosses levels at or better than limit
+       *  instead of o.price.
+       */
+      void match( book_order& o, long long limit, long long now, std::vector<book_fill>& fills );
+
+      /**
+       *  Trades n at its price between the resting order r and o, which
+       *  need not belong to this book.  The caller has checked that n
+       *  satisfies both min_units.
+       */
+      void fill( book_order& r, book_order& o, long long n, long long now, std::vector<book_fill>& fills );
+
+      /**
+       *  Call auction: finds the single price that executes the most
+       *  volume between the active resting bids and asks (ties go to the
+       *  smallest imbalance, then to the price nearest the previous
+       *  clearing) and crosses every order that accepts it at that price.
+       *
+       *  @return the clearing price, or 0 if the book does not cross.
+       */
+      long long clear_auction( long long now, std::vector<book_fill>& fills );
+
+      /**
+       *  Rests o at the back of the queue for its price, the book takes
+       *  ownership of o.
+       */
+      void insert( book_order* o );
+
+      /**
+       *  Takes o out of the book, or out of the trigger table if it is
+       *  stopped, and returns it to the pool.
+       */
+      void remove( book_order& o );
+
+      /**
+       *  Lowers the unfilled quantity of o, which keeps its place in the
+       *  queue of its price or trigger table.
+       */
+      void reduce( book_order& o, long long num_unfilled );
+
+      /**
+       *  Takes the resting order o out of the book without destroying
+       *  it, the caller owns o again.
+       */
+      void unlink( book_order& o );
+
+      /**
+       *  @return true if the last trade reached o.stop_price: at or above
+       *          it for a buy, at or below it for a sell.
+       */
+      bool stop_triggered( const book_order& o )const;
+
+      /**
+       *  Holds o in the trigger table until a trade reaches its
+       *  stop_price, the book takes ownership of o.
+       */
+      void arm( book_order* o );
+
+      /**
+       *  Unlinks the next stop order reached by the last trade, oldest
+       *  first within a stop price, and hands it back to the caller.
+       *
+       *  @return 0 once no stop has been reached
+       */
+      book_order* pop_triggered();
+
+      /**
+       *  @return the oldest order at the best price of side, 0 if side is
+       *          empty
+       */
+      book_order* front( int side );
+
+      const bid_levels&       bids()const       { return m_bids;       }
+      const ask_levels&       asks()const       { return m_asks;       }
+      const buy_stop_levels&  buy_stops()const  { return m_buy_stops;  }
+      const sell_stop_levels& sell_stops()const { return m_sell_stops; }
+
+      /// price of the most recent trade, 0 if there has been none
+      long long last_price()const { return m_last_price; }
+
+      /// every trade made by this book
+      const trade_tape& tape()const { return m_tape; }
+
+      /// sequence number of the most recent depth change
+      uint64_t depth_seq()const { return m_depth_seq; }
+
+      /// every later depth change and top of book is also published to c
+      void set_channel( feed_channel* c ) { m_channel = c; update_quote(); }
+
+      /**
+       *  Copies up to max_levels aggregated levels per side, best first.
+       *  A max_levels of 0 copies every level.
+       *
+       *  @return the sequence number the snapshot reflects
+       */
+      uint64_t get_depth( uint32_t max_levels, std::vector<depth_level>& bids, 
+                                               std::vector<depth_level>& asks )const;
+
+      /**
+       *  Appends every delta after since_seq.  Only the most recent
+       *  max_depth_history deltas are kept, returns false if since_seq
+       *  is older than that and the caller must take a new snapshot.
+       */
+      bool get_depth_deltas( uint64_t since_seq, std::vector<depth_delta>& deltas )const;
+
+      enum { max_depth_history = 4096 };
+
+    private:
+      void publish_level( int side, long long price, const price_level& lvl );
+      void update_quote();
+
+      price_ladder& ladder_of( bid_levels& )  { return m_bid_ladder; }
+      price_ladder& ladder_of( ask_levels& )  { return m_ask_ladder; }
+
+      template<typename Levels>
+      price_level& level_for( Levels& lvls, long long price );
+      template<typename Levels>
+      price_level& level_at( Levels& lvls, long long price );
+      template<typename Levels>
+      void erase_level( Levels& lvls, typename Levels::iterator itr );
+      template<typename Levels>
+      void erase_level( Levels& lvls, long long price );
+
+      template<typename Levels>
+      void match_levels( Levels& lvls, book_order& o, long long limit, long long trade_price,
+                         long long now, std::vector<book_fill>& fills );
+      void cross_level( price_level& lvl, long long price, book_order& o, long long trade_price,
+                        long long now, std::vector<book_fill>& fills );
+      template<typename Levels>
+      void fill_from( Levels& lvls, book_order& r, book_order& o, long long n,
+                      long long now, std::vector<book_fill>& fills );
+      void trade( price_level& lvl, book_order& r, book_order& o, long long n, long long price,
+                  long long now, std::vector<book_fill>& fills );
+      template<typename Levels>
+      void unlink_from( Levels& lvls, book_order& o );
+      template<typename Levels>
+      void reduce_in( Levels& lvls, book_order& o, long long num_unfilled );
+      template<typename Stops>
+      void remove_stop( Stops& stops, book_order& o );
+      template<typename Stops>
+      book_order* pop_stop( Stops& stops );
+
+      std::string      m_stock_note;
+      std::string      m_cur_note;
+      uint32_t         m_pair;
+      pair_key         m_key;
+      order_pool&      m_pool;
+      bid_levels       m_bids;
+      ask_levels       m_asks;
+      price_ladder     m_bid_ladder;
+      price_ladder     m_ask_ladder;
+      buy_stop_levels  m_buy_stops;
+      sell_stop_levels m_sell_stops;
+      long long        m_last_clear;
+      long long        m_last_price;
+      trade_tape       m_tape;
+
+      uint64_t                 m_depth_seq;
+      std::deque<depth_delta>  m_deltas;
+      feed_channel*            m_channel;
+  };
+
+} // namespace ltl
+
+#endif
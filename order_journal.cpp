@@ -0,0 +1,488 @@
+#include <ltl/order_journal.hpp>
+#include <ltl/order_book.hpp>
+#include <ltl/error.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/crc.hpp>
+#include <log/log.hpp>
+#include <fstream>
+#include <cstring>
+#include <map>
+#include <unistd.h>
+
+namespace ltl {
+
+  namespace fs = boost::filesystem;
+
+  static const uint32_t snapshot_magic = 0x534c544c; // "LTLS"
+
+  static void put_u8( std::string& s, uint8_t v )   { s.push_back( char(v) ); }
+  static void put_u32( std::string& s, uint32_t v ) { s.append( (const char*)&v, sizeof(v) ); }
+  static void put_u64( std::string& s, uint64_t v ) { s.append( (const char*)&v, sizeof(v) ); }
+  static void put_str( std::string& s, const std::string& v ) {
+    put_u32( s, v.size() );
+    s.append( v );
+  }
+
+  static uint32_t crc( const char* d, size_t n ) {
+    boost::crc_32_type c;
+    c.process_bytes( d, n );
+    return c.checksum();
+  }
+
+  /**
+   *  Bounds checked reader over one record, every get returns false once
+   *  the record is exhausted.
+   */
+  struct record_reader {
+    record_reader( const char* d, size_t n ):pos(d),end(d+n){}
+
+    template<typename T>
+    bool get( T& v ) {
+      if( size_t(end - pos) < sizeof(T) ) return false;
+      memcpy( &v, pos, sizeof(T) );
+      pos += sizeof(T);
+      return true;
+    }
+    bool get( std::string& v ) {
+      uint32_t n;
+      if( !get(n) || size_t(end - pos) < n ) return false;
+      v.assign( pos, n );
+      pos += n;
+      return true;
+    }
+
+    const char* pos;
+    const char* end;
+  };
+
+  /**
+   *  Reads the next framed record of f into body.
+   *  @return false at the end of the file or at a torn record
+   */
+  static bool read_record( std::istream& f, std::string& body ) {
+    uint32_t size, sum;
+    if( !f.read( (char*)&size, sizeof(size) ) || !f.read( (char*)&sum, sizeof(sum) ) )
+      return false;
+    body.resize( size );
+    if( size && !f.read( &body[0], size ) )
+      return false;
+    return crc( body.data(), body.size() ) == sum;
+  }
+
+  static std::string frame( const std::string& body ) {
+    std::string r;
+    r.reserve( body.size() + 8 );
+    put_u32( r, body.size() );
+    put_u32( r, crc( body.data(), body.size() ) );
+    r.append( body );
+    return r;
+  }
+
+  static std::string encode_order( const order_entry& o ) {
+    std::string p;
+    put_str( p, o.id );
+    put_str( p, o.owner );
+    put_str( p, o.stock_note );
+    put_str( p, o.cur_note );
+    put_u8(  p, o.type );
+    put_u64( p, o.price );
+    put_u64( p, o.num_unfilled );
+    put_u64( p, o.min_unit );
+    put_u64( p, o.start_date );
+    put_u64( p, o.end_date );
+    put_u64( p, o.stop_price );
+    put_str( p, o.funds_account );
+    return p;
+  }
+
+  static bool decode_order( record_reader& r, order_entry& o ) {
+    uint8_t type;
+    if( r.get(o.id) && r.get(o.owner) && r.get(o.stock_note) && r.get(o.cur_note) && r.get(type) &&
+        r.get(o.price) && r.get(o.num_unfilled) && r.get(o.min_unit) &&
+        r.get(o.start_date) && r.get(o.end_date) ) {
+      o.type = type;
+      return r.get(o.stop_price) && r.get(o.funds_account);
+    }
+    return false;
+  }
+
+  static fs::path journal_file( const fs::path& dir, uint64_t gen, uint32_t shard, const char* ext ) {
+    return dir / ( boost::lexical_cast<std::string>(gen) + "." + boost::lexical_cast<std::string>(shard) + ext );
+  }
+
+  static void sync_and_close( FILE* f, const fs::path& p ) {
+    if( fflush(f) != 0 || fsync( fileno(f) ) != 0 ) {
+      fclose(f);
+      LTL_THROW( "Unable to write '%1%'", %p.string() );
+    }
+    fclose(f);
+  }
+
+  /**
+   *  @return true for the records that change the database
+   */
+  static bool is_redo( uint8_t type ) {
+    return type == order_journal::fill || type == order_journal::cancel || type == order_journal::expire ||
+           type == order_journal::amend || type == order_journal::trade;
+  }
+
+  order_journal::order_journal( const fs::path& dir, uint64_t gen, uint32_t shard )
+  :m_log_path( journal_file( dir, gen, shard, ".log" ) ),
+   m_snap_path( journal_file( dir, gen, shard, ".snap" ) ),
+   m_key_prefix( boost::lexical_cast<std::string>(gen) + "." + boost::lexical_cast<std::string>(shard) + "." ),
+   m_lsn(1),m_since_snapshot(0),m_untagged(0) {
+    fs::create_directories( dir );
+    m_log = fopen( m_log_path.string().c_str(), "wb" );
+    if( !m_log ) {
+      LTL_THROW( "Unable to open journal '%1%'", %m_log_path.string() );
+    }
+  }
+
+  order_journal::~order_journal() {
+    fclose( m_log );
+  }
+
+  std::string order_journal::append( uint8_t type, const std::string& payload ) {
+    std::string body;
+    body.reserve( payload.size() + 9 );
+    put_u8( body, type );
+    put_u64( body, m_lsn++ );
+    body.append( payload );
+    std::string r = frame( body );
+    if( fwrite( r.data(), 1, r.size(), m_log ) != r.size() ) {
+      LTL_THROW( "Unable to append to journal '%1%'", %m_log_path.string() );
+    }
+    ++m_since_snapshot;
+    return body;
+  }
+
+  void order_journal::append_redo( uint8_t type, const std::string& payload ) {
+    m_redo.push_back( std::make_pair( uint64_t(0), append( type, payload ) ) );
+    ++m_untagged;
+  }
+
+  /**
+   *  Forgets the records whose writes the writer has committed.
+   */
+  void order_journal::trim( uint64_t committed ) {
+    while( m_redo.size() > m_untagged && m_redo.front().first <= committed )
+      m_redo.pop_front();
+  }
+
+  void order_journal::log_new( const order_entry& o ) {
+    append( new_order, encode_order(o) );
+  }
+
+  void order_journal::log_fill( const std::string& order_id, long long num_unfilled ) {
+    std::string p;
+    put_str( p, order_id );
+    put_u64( p, num_unfilled );
+    append_redo( fill, p );
+  }
+
+  void order_journal::log_cancel( const std::string& order_id, long long num_unfilled ) {
+    std::string p;
+    put_str( p, order_id );
+    put_u64( p, num_unfilled );
+    append_redo( cancel, p );
+  }
+
+  void order_journal::log_expire( const std::string& order_id, long long num_unfilled ) {
+    std::string p;
+    put_str( p, order_id );
+    put_u64( p, num_unfilled );
+    append_redo( expire, p );
+  }
+
+  void order_journal::log_trigger( const std::string& order_id ) {
+    std::string p;
+    put_str( p, order_id );
+    append( trigger, p );
+  }
+
+  void order_journal::log_amend( const std::string& order_id, long long num_unfilled, long long price ) {
+    std::string p;
+    put_str( p, order_id );
+    put_u64( p, num_unfilled );
+    put_u64( p, price );
+    append_redo( amend, p );
+  }
+
+  std::string order_journal::log_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                                        long long num, long long price, long long timestamp,
+                                        int implied, bool bridge ) {
+    std::string key = m_key_prefix + boost::lexical_cast<std::string>( m_lsn );
+    std::string p;
+    put_str( p, key );
+    put_str( p, buy_order_id );
+    put_str( p, sell_order_id );
+    put_u64( p, num );
+    put_u64( p, price );
+    put_u64( p, timestamp );
+    put_u8(  p, implied );
+    put_u8(  p, bridge );
+    append_redo( trade, p );
+    return key;
+  }
+
+  void order_journal::commit( uint64_t queued, uint64_t committed ) {
+    fflush( m_log );
+    for( size_t i = m_redo.size() - m_untagged; i < m_redo.size(); ++i )
+      m_redo[i].first = queued;
+    m_untagged = 0;
+    trim( committed );
+  }
+
+  void order_journal::carry( const std::vector<std::string>& redo ) {
+    for( uint32_t i = 0; i < redo.size(); ++i ) {
+      record_reader r( redo[i].data(), redo[i].size() );
+      uint8_t  type;
+      uint64_t lsn;
+      if( r.get(type) && r.get(lsn) )
+        append_redo( type, std::string( r.pos, r.end ) );
+    }
+  }
+
+  bool order_journal::decode_redo( const std::string& record, journal_redo& d ) {
+    record_reader r( record.data(), record.size() );
+    uint64_t lsn, n, price, ts;
+    uint8_t  implied, bridge;
+    if( !r.get(d.type) || !r.get(lsn) || !is_redo(d.type) )
+      return false;
+    if( d.type == trade ) {
+      if( !r.get(d.key) || !r.get(d.order_id) || !r.get(d.sell_order_id) || !r.get(n) || !r.get(price) ||
+          !r.get(ts) || !r.get(implied) || !r.get(bridge) )
+        return false;
+      d.price     = price;
+      d.timestamp = ts;
+      d.implied   = implied;
+      d.bridge    = bridge != 0;
+    } else {
+      if( !r.get(d.order_id) || !r.get(n) )
+        return false;
+      if( d.type == amend ) {
+        if( !r.get(price) ) return false;
+        d.price = price;
+      }
+    }
+    d.num = n;
+    return true;
+  }
+
+  void order_journal::write_snapshot( const std::vector<order_entry>& orders, uint64_t committed ) {
+    fs::path tmp = m_snap_path.string() + ".tmp";
+    FILE* f = fopen( tmp.string().c_str(), "wb" );
+    if( !f ) {
+      LTL_THROW( "Unable to open snapshot '%1%'", %tmp.string() );
+    }
+    std::string head;
+    put_u32( head, snapshot_magic );
+    put_u64( head, m_lsn );      // log records before this are included
+    put_u64( head, orders.size() );
+    fwrite( head.data(), 1, head.size(), f );
+
+    for( uint32_t i = 0; i < orders.size(); ++i ) {
+      std::string body;
+      put_u8( body, new_order );
+      put_u64( body, 0 );
+      body.append( encode_order( orders[i] ) );
+      std::string r = frame( body );
+      fwrite( r.data(), 1, r.size(), f );
+    }
+
+    // the log is truncated below, what the writer may not have committed moves here
+    trim( committed );
+    std::string count;
+    put_u64( count, m_redo.size() );
+    fwrite( count.data(), 1, count.size(), f );
+    for( redo_queue::const_iterator itr = m_redo.begin(); itr != m_redo.end(); ++itr ) {
+      std::string r = frame( itr->second );
+      fwrite( r.data(), 1, r.size(), f );
+    }
+    sync_and_close( f, tmp );
+    fs::rename( tmp, m_snap_path );
+
+    fclose( m_log );
+    m_log = fopen( m_log_path.string().c_str(), "wb" );
+    if( !m_log ) {
+      LTL_THROW( "Unable to open journal '%1%'", %m_log_path.string() );
+    }
+    m_since_snapshot = 0;
+  }
+
+  uint64_t order_journal::current_generation( const fs::path& dir ) {
+    std::ifstream in( (dir / "CURRENT").string().c_str() );
+    uint64_t gen = 0;
+    if( in ) in >> gen;
+    return gen;
+  }
+
+  void order_journal::set_current( const fs::path& dir, uint64_t gen ) {
+    fs::create_directories( dir );
+    fs::path tmp = dir / "CURRENT.tmp";
+    FILE* f = fopen( tmp.string().c_str(), "wb" );
+    if( !f ) {
+      LTL_THROW( "Unable to open '%1%'", %tmp.string() );
+    }
+    fprintf( f, "%llu\n", (unsigned long long)gen );
+    sync_and_close( f, tmp );
+    fs::rename( tmp, dir / "CURRENT" );
+
+    std::string          prefix = boost::lexical_cast<std::string>(gen) + ".";
+    std::vector<fs::path> old;
+    for( fs::directory_iterator itr( dir ); itr != fs::directory_iterator(); ++itr ) {
+      std::string name = itr->path().filename().string();
+      std::string ext  = itr->path().extension().string();
+      if( ( ext == ".log" || ext == ".snap" || ext == ".tmp" ) && name.compare( 0, prefix.size(), prefix ) != 0 )
+        old.push_back( itr->path() );
+    }
+    for( uint32_t i = 0; i < old.size(); ++i )
+      fs::remove( old[i] );
+  }
+
+  /**
+   *  Open orders of one shard while its snapshot and log are replayed.
+   */
+  struct replay_state {
+    typedef std::map<uint64_t, order_entry>                arrival_map;
+    typedef boost::unordered_map<std::string, uint64_t>    id_map;
+
+    replay_state():next(0){}
+
+    void add( const order_entry& o ) {
+      remove( o.id );
+      ids[o.id]      = next;
+      orders[next++] = o;
+    }
+    void remove( const std::string& id ) {
+      id_map::iterator itr = ids.find( id );
+      if( itr == ids.end() ) return;
+      orders.erase( itr->second );
+      ids.erase( itr );
+    }
+    void clear_stop( const std::string& id ) {
+      id_map::iterator itr = ids.find( id );
+      if( itr != ids.end() )
+        orders[itr->second].stop_price = 0;
+    }
+    /// a new price moves the order to the back, as it does in the book
+    void amend( const std::string& id, long long n, long long price ) {
+      id_map::iterator itr = ids.find( id );
+      if( itr == ids.end() ) return;
+      order_entry& o = orders[itr->second];
+      o.num_unfilled = n;
+      if( o.price != price ) {
+        o.price = price;
+        order_entry moved = o;
+        add( moved );
+      }
+    }
+    void set_unfilled( const std::string& id, long long n ) {
+      id_map::iterator itr = ids.find( id );
+      if( itr == ids.end() ) return;
+      if( n == 0 )
+        remove( id );
+      else
+        orders[itr->second].num_unfilled = n;
+    }
+    void apply( uint8_t type, record_reader& r ) {
+      if( type == order_journal::new_order ) {
+        order_entry o;
+        if( decode_order( r, o ) )
+          add( o );
+        return;
+      }
+      if( type == order_journal::trade )
+        return;
+      std::string id;
+      if( !r.get( id ) ) return;
+      if( type == order_journal::fill ) {
+        uint64_t n;
+        if( r.get( n ) ) set_unfilled( id, n );
+      } else if( type == order_journal::trigger ) {
+        clear_stop( id );
+      } else if( type == order_journal::amend ) {
+        uint64_t n, price;
+        if( r.get( n ) && r.get( price ) ) amend( id, n, price );
+      } else {
+        remove( id );
+      }
+    }
+
+    uint64_t    next;
+    arrival_map orders;
+    id_map      ids;
+  };
+
+  static void replay_shard( const fs::path& snap, const fs::path& log, std::vector<order_entry>& out,
+                            std::vector<std::string>& redo ) {
+    replay_state st;
+    uint64_t     snap_lsn = 0;
+    std::string  body;
+
+    std::ifstream sf( snap.string().c_str(), std::ios::binary );
+    if( sf ) {
+      uint32_t magic;
+      uint64_t count;
+      if( !sf.read( (char*)&magic, sizeof(magic) ) || magic != snapshot_magic ||
+          !sf.read( (char*)&snap_lsn, sizeof(snap_lsn) ) || !sf.read( (char*)&count, sizeof(count) ) ) {
+        LTL_THROW( "Corrupt snapshot '%1%'", %snap.string() );
+      }
+      for( uint64_t i = 0; i < count; ++i ) {
+        if( !read_record( sf, body ) ) {
+          LTL_THROW( "Corrupt snapshot '%1%'", %snap.string() );
+        }
+        record_reader r( body.data(), body.size() );
+        uint8_t  type;
+        uint64_t lsn;
+        if( r.get(type) && r.get(lsn) )
+          st.apply( type, r );
+      }
+      uint64_t redo_count;
+      if( !sf.read( (char*)&redo_count, sizeof(redo_count) ) ) {
+        LTL_THROW( "Corrupt snapshot '%1%'", %snap.string() );
+      }
+      for( uint64_t i = 0; i < redo_count; ++i ) {
+        if( !read_record( sf, body ) ) {
+          LTL_THROW( "Corrupt snapshot '%1%'", %snap.string() );
+        }
+        redo.push_back( body );
+      }
+    }
+
+    std::ifstream lf( log.string().c_str(), std::ios::binary );
+    uint64_t replayed = 0;
+    while( lf && read_record( lf, body ) ) {
+      record_reader r( body.data(), body.size() );
+      uint8_t  type;
+      uint64_t lsn;
+      if( !r.get(type) || !r.get(lsn) ) break;
+      if( lsn < snap_lsn ) continue;
+      st.apply( type, r );
+      if( is_redo( type ) )
+        redo.push_back( body );
+      ++replayed;
+    }
+    slog( "replayed %1% journal records after snapshot %2%", replayed, snap.string() );
+
+    for( replay_state::arrival_map::iterator itr = st.orders.begin(); itr != st.orders.end(); ++itr )
+      out.push_back( itr->second );
+  }
+
+  void order_journal::replay( const fs::path& dir, uint64_t gen, std::vector<order_entry>& orders,
+                              std::vector<std::string>& redo ) {
+    std::string prefix = boost::lexical_cast<std::string>(gen) + ".";
+    for( fs::directory_iterator itr( dir ); itr != fs::directory_iterator(); ++itr ) {
+      fs::path    p    = itr->path();
+      std::string name = p.filename().string();
+      if( p.extension() != ".log" || name.compare( 0, prefix.size(), prefix ) != 0 )
+        continue;
+      fs::path snap = p;
+      snap.replace_extension( ".snap" );
+      replay_shard( snap, p, orders, redo );
+    }
+  }
+
+} // namespace ltl
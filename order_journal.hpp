@@ -0,0 +1,157 @@
+#ifndef _LTL_ORDER_JOURNAL_HPP_
+#define _LTL_ORDER_JOURNAL_HPP_
+#include <boost/filesystem/path.hpp>
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace ltl {
+
+  struct order_entry;
+
+  /**
+   *  A journal record that changes the market database, see
+   *  order_journal::decode_redo.
+   */
+  struct journal_redo {
+    journal_redo():type(0),num(0),price(0),timestamp(0),implied(0),bridge(false){}
+
+    uint8_t     type;
+    std::string order_id;       // the buy order of a trade
+    std::string sell_order_id;  // trades only
+    long long   num;            // the unfilled quantity unless a trade
+    long long   price;          // amends and trades
+    long long   timestamp;      // trades only
+    int         implied;        // trades only, see market_writer::add_trade
+    bool        bridge;
+    std::string key;            // trades only, journal_key of the market_trade row
+  };
+
+  /**
+   *  Append-only log of the changes a market makes to its open orders,
+   *  plus periodic snapshots of every open order.
+   *
+   *  Each shard of the matching engine writes its own journal, the files
+   *  are <gen>.<shard>.log and <gen>.<shard>.snap in the journal directory.
+   *  A generation is a complete set of journals for one run of the engine,
+   *  the CURRENT file names the generation to recover from so that the
+   *  shard count may change between runs.
+   *
+   *  Every record carries a log sequence number and a crc.  A snapshot
+   *  stores the last lsn it includes, replay skips older log records so
+   *  a crash between writing a snapshot and truncating the log is
+   *  harmless, and stops at the first torn record.
+   *
+   *  The journal runs ahead of the market_writer.  Records that change
+   *  the database (trades, fills, cancels, expiries and amends) are kept
+   *  until the writer has committed the writes they were queued with,
+   *  and a snapshot carries the ones it has not.  On start they are
+   *  replayed into the writer, see market::redo.  Trades are identified
+   *  by a key stored with their row so that a trade the writer did
+   *  commit is not written twice.
+   */
+  class order_journal {
+    public:
+      enum event_type {
+        new_order = 1,
+        fill      = 2,
+        cancel    = 3,
+        expire    = 4,
+        trigger   = 5,  // a stop order became a limit order
+        amend     = 6,  // new unfilled quantity and price, see market::amend_order
+        trade     = 7   // a trade as queued for the market_writer
+      };
+
+      /**
+       *  Starts an empty journal for shard in generation gen.
+       */
+      order_journal( const boost::filesystem::path& dir, uint64_t gen, uint32_t shard );
+      ~order_journal();
+
+      void log_new( const order_entry& o );
+      void log_fill( const std::string& order_id, long long num_unfilled );
+      void log_cancel( const std::string& order_id, long long num_unfilled );
+      void log_expire( const std::string& order_id, long long num_unfilled );
+      void log_trigger( const std::string& order_id );
+      void log_amend( const std::string& order_id, long long num_unfilled, long long price );
+
+      /**
+       *  @return the key of the trade, unique across generations and shards
+       */
+      std::string log_trade( const std::string& buy_order_id, const std::string& sell_order_id,
+                             long long num, long long price, long long timestamp,
+                             int implied, bool bridge );
+
+      /**
+       *  Hands the records logged so far to the operating system, called
+       *  once per market operation.
+       *
+       *  @param queued    market_writer::queued() after the operation, the
+       *                   records logged since the last commit are kept
+       *                   until the writer has committed that many writes
+       *  @param committed market_writer::committed()
+       */
+      void commit( uint64_t queued, uint64_t committed );
+
+      /**
+       *  Logs records that an earlier generation had not seen committed,
+       *  as returned by replay().  The caller queues them for the writer.
+       */
+      void carry( const std::vector<std::string>& redo );
+
+      /// records logged since the last snapshot
+      uint64_t events_since_snapshot()const { return m_since_snapshot; }
+
+      /**
+       *  Replaces the snapshot with orders, which must be in arrival
+       *  order, and the records the writer has not committed yet, and
+       *  starts a new log.
+       */
+      void write_snapshot( const std::vector<order_entry>& orders, uint64_t committed );
+
+      /**
+       *  @return the generation named by CURRENT or 0 if there is none
+       */
+      static uint64_t current_generation( const boost::filesystem::path& dir );
+
+      /**
+       *  Rebuilds the open orders of every shard of generation gen in
+       *  arrival order.  redo receives the records that may not have
+       *  reached the database, oldest first within each shard.
+       */
+      static void replay( const boost::filesystem::path& dir, uint64_t gen, std::vector<order_entry>& orders,
+                          std::vector<std::string>& redo );
+
+      /**
+       *  @return false if the record is not one that changes the database
+       */
+      static bool decode_redo( const std::string& record, journal_redo& r );
+
+      /**
+       *  Makes gen the generation to recover from and removes the files of
+       *  every other generation.
+       */
+      static void set_current( const boost::filesystem::path& dir, uint64_t gen );
+
+    private:
+      typedef std::deque< std::pair<uint64_t, std::string> > redo_queue;
+
+      std::string append( uint8_t type, const std::string& payload );
+      void        append_redo( uint8_t type, const std::string& payload );
+      void        trim( uint64_t committed );
+
+      boost::filesystem::path m_log_path;
+      boost::filesystem::path m_snap_path;
+      std::string             m_key_prefix;  // <gen>.<shard>.
+      FILE*                   m_log;
+      uint64_t                m_lsn;
+      uint64_t                m_since_snapshot;
+      redo_queue              m_redo;        // writer ticket and record, oldest first
+      size_t                  m_untagged;    // records at the back of m_redo logged since the last commit
+  };
+
+} // namespace ltl
+
+#endif
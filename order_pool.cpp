@@ -0,0 +1,54 @@
+#include <ltl/order_pool.hpp>
+#include <ltl/order_book.hpp>
+#include <new>
+
+namespace ltl {
+
+  order_pool::order_pool()
+  :m_live(0){}
+
+  order_pool::~order_pool() {
+    // the books and queues that own the records have destroyed them already
+    for( uint32_t i = 0; i < m_slabs.size(); ++i )
+      ::operator delete( m_slabs[i] );
+  }
+
+  book_order* order_pool::at( uint32_t slot )const {
+    return reinterpret_cast<book_order*>( m_slabs[slot / slab_size] ) + slot % slab_size;
+  }
+
+  void order_pool::grow() {
+    uint32_t first = m_slabs.size() * slab_size;
+    m_slabs.push_back( static_cast<char*>( ::operator new( slab_size * sizeof(book_order) ) ) );
+    m_ids.resize( first + slab_size );
+    // hand out the lowest slots first so that live records stay packed
+    for( uint32_t i = slab_size; i > 0; --i )
+      m_free.push_back( first + i - 1 );
+  }
+
+  book_order* order_pool::alloc( const std::string& id ) {
+    if( m_free.empty() )
+      grow();
+    uint32_t slot = m_free.back();
+    m_free.pop_back();
+
+    book_order* o = new (at(slot)) book_order();
+    o->slot     = slot;
+    m_ids[slot] = id;
+    ++m_live;
+    return o;
+  }
+
+  void order_pool::free( book_order* o ) {
+    uint32_t slot = o->slot;
+    o->~book_order();
+    m_retired.push_back( slot );
+    --m_live;
+  }
+
+  void order_pool::reclaim() {
+    m_free.insert( m_free.end(), m_retired.begin(), m_retired.end() );
+    m_retired.clear();
+  }
+
+} // namespace ltl
@@ -0,0 +1,67 @@
+#ifndef _LTL_ORDER_POOL_HPP_
+#define _LTL_ORDER_POOL_HPP_
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ltl {
+
+  struct book_order;
+
+  /**
+   *  Slab allocator for the book_orders of one market.
+   *
+   *  Records are carved out of slabs of slab_size records that are never
+   *  returned to the heap, so placing an order costs no allocation once
+   *  the pool has grown to the number of open orders.  Each record is
+   *  known by its slot, its position across the slabs.  The id of the
+   *  order_trx is kept beside the records, indexed by slot, so that the
+   *  records themselves hold no strings.
+   *
+   *  Freed slots are retired rather than reused immediately: the id of
+   *  an order that was completely filled stays readable until reclaim()
+   *  is called, which the market does once it has recorded every fill.
+   *
+   *  Not thread safe, a pool belongs to the thread of its market.
+   */
+  class order_pool {
+    public:
+      enum { slab_size = 1024 };
+
+      order_pool();
+      ~order_pool();
+
+      /**
+       *  @return a default constructed record for the order with id
+       */
+      book_order* alloc( const std::string& id );
+
+      /**
+       *  Destroys o, its slot is retired until reclaim().
+       */
+      void        free( book_order* o );
+
+      /**
+       *  Makes every retired slot available to alloc() again.
+       */
+      void        reclaim();
+
+      const std::string& id( uint32_t slot )const { return m_ids[slot]; }
+
+      /// records currently allocated
+      uint32_t    size()const { return m_live; }
+
+    private:
+      book_order* at( uint32_t slot )const;
+      void        grow();
+
+      std::vector<char*>       m_slabs;
+      std::vector<uint32_t>    m_free;
+      std::vector<uint32_t>    m_retired;
+      std::vector<std::string> m_ids;
+      uint32_t                 m_live;
+  };
+
+} // namespace ltl
+
+#endif
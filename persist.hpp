@@ -54,8 +54,6 @@ namespace ltl {
         dbo::id( a, m_id, "id" );
         dbo::field( a, m_balance, "balance" );
         dbo::field( a, m_date, "date" );
-        dbo::field( a, m_sig_nums, "sig_nums" );
-        dbo::field( a, m_new_sig_nums, "new_sig_nums" );
 
         dbo::belongsTo( a, m_owner, "owner", dbo::OnDeleteSetNull );
         dbo::belongsTo( a, m_type,  "type",  dbo::OnDeleteSetNull );
@@ -63,6 +61,14 @@ namespace ltl {
         dbo::hasMany( a, m_in_box,  dbo::ManyToMany, "in_box" );
         dbo::hasMany( a, m_out_box, dbo::ManyToMany, "out_box" );
         dbo::hasMany( a, m_applied, dbo::ManyToMany, "applied" );
+        dbo::hasMany( a, m_sig_numbers, dbo::ManyToOne, "sig_numbers" );
+      }
+
+      template<typename Action>
+      void sig_number::persist( Action& a ) {
+        dbo::belongsTo( a, acnt, "sig_numbers", dbo::OnDeleteCascade );
+        dbo::field( a, num, "num" );
+        dbo::field( a, state, "state" );
       }
 
       template<typename Action>
@@ -84,6 +90,8 @@ namespace ltl {
         dbo::id( a, order_trx, "order_trx" );
         dbo::field( a, fill_trx, "fill_trx" );
         dbo::field( a, type, "type" );
+        dbo::field( a, status, "status" );
+        dbo::field( a, owner, "owner" );
         dbo::field( a, stock_note, "stock_note" );
         dbo::field( a, cur_note, "cur_note" );
         dbo::field( a, num, "num" );
@@ -91,9 +99,12 @@ namespace ltl {
         dbo::field( a, start_date, "start_date" );
         dbo::field( a, end_date, "end_date" );
         dbo::field( a, min_unit, "min_unit" );
+        dbo::field( a, stop_price, "stop_price" );
+        dbo::field( a, funds_account, "funds_account" );
         dbo::field( a, num_unfilled, "num_unfilled" );
         dbo::hasMany( a, buy_trades, dbo::ManyToOne, "buy_trades" );
         dbo::hasMany( a, sell_trades, dbo::ManyToOne, "sell_trades" );
+        dbo::hasMany( a, amends, dbo::ManyToOne, "amends" );
       }
 
       template<typename Action>
@@ -103,5 +114,32 @@ namespace ltl {
         dbo::field( a, num, "num" );
         dbo::field( a, price, "price" );
         dbo::field( a, timestamp, "timestamp" );
+        dbo::field( a, journal_key, "journal_key" );
+      }
+
+      template<typename Action>
+      void order_amend::persist( Action& a ) {
+        dbo::belongsTo( a, order, "amends" );
+        dbo::field( a, num_unfilled, "num_unfilled" );
+        dbo::field( a, price, "price" );
+        dbo::field( a, date, "date" );
+        dbo::field( a, owner_sig, "owner_sig" );
+      }
+
+      /**
+       *  Maps every persistent class, each session on the database
+       *  needs the same mapping.
+       */
+      inline void map_classes( dbo::Session& s ) {
+        s.mapClass<identity>("identity");
+        s.mapClass<private_identity>("private_identity");
+        s.mapClass<asset>("asset");
+        s.mapClass<asset_note>("asset_note");
+        s.mapClass<account>("account");
+        s.mapClass<sig_number>("sig_number");
+        s.mapClass<transaction>("transaction");
+        s.mapClass<market_order>("market_order");
+        s.mapClass<market_trade>("market_trade");
+        s.mapClass<order_amend>("order_amend");
       }
 }
@@ -46,6 +46,48 @@ namespace ltl { namespace rpc {
       boost::optional<std::string> server_account_signature;
     };
 
+    struct market_depth_request {
+      std::string                 stock_note_id;
+      std::string                 cur_note_id;
+      boost::optional<uint32_t>   max_levels;   // all levels if not given
+    };
+
+    struct market_depth_updates_request {
+      std::string                 stock_note_id;
+      std::string                 cur_note_id;
+      uint64_t                    since_seq;
+    };
+
+    struct watch_market {
+      std::string                 stock_note_id;
+      std::string                 cur_note_id;
+    };
+
+    /**
+     *  owner_signature signs the digest of order_id, num_unfilled, price
+     *  and date, see ltl::order_amend::digest
+     */
+    struct amend_order {
+      std::string                 order_id;
+      int64_t                     num_unfilled;
+      int64_t                     price;
+      uint64_t                    date;
+      std::string                 owner_signature;
+    };
+
+    struct quote_request {
+      std::string                 stock_note_id;
+      std::string                 cur_note_id;
+    };
+
+    struct market_stats_request {
+      std::string                 stock_note_id;
+      std::string                 cur_note_id;
+      boost::optional<uint32_t>   window_ms;      // 24 hours if not given
+      boost::optional<uint32_t>   resolution_ms;  // 1 minute candles if not given
+      boost::optional<uint32_t>   max_candles;    // 60 if not given
+    };
+
     /**
      *  To request the account requires that the current date
      *  be signed with the private key of the account or that
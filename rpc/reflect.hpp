@@ -13,6 +13,13 @@ BOOST_REFLECT_FWD( ltl::rpc::signature_line )
 BOOST_REFLECT_FWD( ltl::rpc::transaction )
 BOOST_REFLECT_FWD( ltl::rpc::account )
 BOOST_REFLECT_FWD( ltl::rpc::market_offer )
+BOOST_REFLECT_FWD( ltl::rpc::depth_level )
+BOOST_REFLECT_FWD( ltl::rpc::market_depth )
+BOOST_REFLECT_FWD( ltl::rpc::depth_update )
+BOOST_REFLECT_FWD( ltl::rpc::market_depth_updates )
+BOOST_REFLECT_FWD( ltl::rpc::market_candle )
+BOOST_REFLECT_FWD( ltl::rpc::market_stats )
+BOOST_REFLECT_FWD( ltl::rpc::market_quote )
 
 BOOST_REFLECT( ltl::rpc::msg::allocate_signatures, 
   (account_id)(count) )
@@ -31,6 +38,19 @@ BOOST_REFLECT( ltl::rpc::msg::balance_agreement_reply,
 BOOST_REFLECT( ltl::rpc::msg::account_request,
   (account_id)(date)(signature) )
 
+BOOST_REFLECT( ltl::rpc::msg::market_depth_request,
+  (stock_note_id)(cur_note_id)(max_levels) )
+BOOST_REFLECT( ltl::rpc::msg::market_depth_updates_request,
+  (stock_note_id)(cur_note_id)(since_seq) )
+BOOST_REFLECT( ltl::rpc::msg::watch_market,
+  (stock_note_id)(cur_note_id) )
+BOOST_REFLECT( ltl::rpc::msg::amend_order,
+  (order_id)(num_unfilled)(price)(date)(owner_signature) )
+BOOST_REFLECT( ltl::rpc::msg::quote_request,
+  (stock_note_id)(cur_note_id) )
+BOOST_REFLECT( ltl::rpc::msg::market_stats_request,
+  (stock_note_id)(cur_note_id)(window_ms)(resolution_ms)(max_candles) )
+
 BOOST_REFLECT_IMPL( ltl::rpc::identity,
   (id)
   (pub_key)
@@ -113,6 +133,68 @@ BOOST_REFLECT_IMPL( ltl::rpc::market_offer,
   (expire_date)
 )
 
+BOOST_REFLECT_IMPL( ltl::rpc::depth_level,
+  (price)
+  (quantity)
+  (orders)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::market_depth,
+  (stock_note_id)
+  (cur_note_id)
+  (seq)
+  (bids)
+  (asks)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::depth_update,
+  (seq)
+  (side)
+  (price)
+  (quantity)
+  (orders)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::market_depth_updates,
+  (since_seq)
+  (seq)
+  (snapshot_required)
+  (updates)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::market_quote,
+  (stock_note_id)
+  (cur_note_id)
+  (seq)
+  (bid)
+  (bid_quantity)
+  (ask)
+  (ask_quantity)
+  (last_price)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::market_candle,
+  (start)
+  (open)
+  (high)
+  (low)
+  (close)
+  (volume)
+  (trades)
+)
+
+BOOST_REFLECT_IMPL( ltl::rpc::market_stats,
+  (stock_note_id)
+  (cur_note_id)
+  (last_price)
+  (volume)
+  (vwap)
+  (trades)
+  (window_ms)
+  (resolution_ms)
+  (candles)
+)
+
 
 BOOST_REFLECT_ANY( ltl::rpc::session,
   (get_host_identity)
@@ -131,7 +213,16 @@ BOOST_REFLECT_ANY( ltl::rpc::session,
 
   (post_market_offer)
   (cancel_market_offer)
+  (amend_market_offer)
+  (cancel_market_offers)
   (get_market_offers)
+  (get_market_depth)
+  (get_market_depth_updates)
+  (get_market_stats)
+  (get_quote)
+  (watch_market)
+  (poll_market)
+  (unwatch_market)
 
   (allocate_signature_numbers)
   (sign_transaction)
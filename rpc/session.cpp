@@ -2,17 +2,35 @@
 #include <ltl/transaction.hpp>
 #include <ltl/rpc/session.hpp>
 #include <ltl/server.hpp>
+#include <ltl/order_book.hpp>
+#include <ltl/market_feed.hpp>
 #include <ltl/error.hpp>
+#include <boost/lexical_cast.hpp>
 #include <set>
+#include <map>
 #include <scrypt/base64.hpp>
 #include <scrypt/scrypt.hpp>
 
 namespace ltl { namespace rpc {
 
+  /// watches one session may hold, each costs a subscription on its channel
+  static const uint32_t max_watches = 64;
+
+  struct market_watch {
+    std::string                  stock_note_id;
+    std::string                  cur_note_id;
+    ltl::market_subscription_ptr sub;
+    uint64_t                     seq;   // as of the previous poll
+  };
+
   class session_private {
     public:
-      ltl::server::ptr      serv;
-      std::set<std::string> authenticated_accounts;
+      session_private():next_watch(0){}
+
+      ltl::server::ptr                    serv;
+      std::set<std::string>               authenticated_accounts;
+      std::map<std::string, market_watch> watches;
+      uint64_t                            next_watch;
   };
 
 
@@ -20,7 +38,11 @@ namespace ltl { namespace rpc {
     my = new session_private();
     my->serv = s;
   }
-  session::~session() { delete my; }
+  session::~session() {
+    for( std::map<std::string, market_watch>::iterator itr = my->watches.begin(); itr != my->watches.end(); ++itr )
+      my->serv->unwatch_market( itr->second.stock_note_id, itr->second.cur_note_id, itr->second.sub );
+    delete my;
+  }
 
   identity session::get_host_identity() {
     return identity();
@@ -238,12 +260,206 @@ namespace ltl { namespace rpc {
     return "Error";
   }
 
+  /**
+   *  Cancels an open offer, the caller must be authenticated as the
+   *  identity that owns it.
+   */
   std::string session::cancel_market_offer( const std::string& oid ) {
-    return "Error";
+    std::string owner = my->serv->get_order_owner( oid );
+    if( owner.empty() ) {
+      LTL_THROW( "Unknown open market offer '%1%'", %oid );
+    }
+    if( my->authenticated_accounts.find( owner ) == my->authenticated_accounts.end() ) {
+      LTL_THROW( "Access Denied" );
+    }
+    return my->serv->cancel_order( oid ) ? "OK" : "Error";
   }
+
+  /**
+   *  Changes the quantity and price of an open offer, the caller must be
+   *  authenticated as the identity that owns it and sign the change.
+   */
+  std::string session::amend_market_offer( const msg::amend_order& am ) {
+    std::string owner = my->serv->get_order_owner( am.order_id );
+    if( owner.empty() ) {
+      LTL_THROW( "Unknown open market offer '%1%'", %am.order_id );
+    }
+    if( my->authenticated_accounts.find( owner ) == my->authenticated_accounts.end() ) {
+      LTL_THROW( "Access Denied" );
+    }
+    return my->serv->amend_order( am.order_id, am.num_unfilled, am.price, am.date,
+                                  scrypt::from_base64<signature>( am.owner_signature ) ) ? "OK" : "Error";
+  }
+
+  /**
+   *  Cancels every open offer of an authenticated identity.
+   *  @return the number of offers cancelled
+   */
+  uint32_t session::cancel_market_offers( const std::string& identity_id ) {
+    if( my->authenticated_accounts.find( identity_id ) == my->authenticated_accounts.end() ) {
+      LTL_THROW( "Access Denied" );
+    }
+    return my->serv->cancel_orders( identity_id );
+  }
+  /**
+   *  Returns the asks for buying baid with said at or below max_price
+   *  aggregated per price level, best price first.
+   */
   std::vector<market_offer> session::get_market_offers( const std::string& baid, const std::string& said,
                                                         int64_t max_price ) {
-    return std::vector<market_offer>(); 
+    std::vector<ltl::depth_level> bids;
+    std::vector<ltl::depth_level> asks;
+    my->serv->get_market_depth( baid, said, 0, bids, asks );
+
+    std::vector<market_offer> offers;
+    for( uint32_t i = 0; i < asks.size() && asks[i].price <= max_price; ++i ) {
+      market_offer mo;
+      mo.buy_asset_id  = baid;
+      mo.sell_asset_id = said;
+      mo.buy_count     = asks[i].quantity;
+      mo.max_price     = asks[i].price;
+      mo.min_size      = 0;
+      mo.start_date    = 0;
+      mo.expire_date   = 0;
+      offers.push_back(mo);
+    }
+    return offers;
+  }
+
+  static void to_rpc( const std::vector<ltl::depth_level>& dl, std::vector<depth_level>& rdl ) {
+    rdl.resize( dl.size() );
+    for( uint32_t i = 0; i < dl.size(); ++i ) {
+      rdl[i].price    = dl[i].price;
+      rdl[i].quantity = dl[i].quantity;
+      rdl[i].orders   = dl[i].orders;
+    }
+  }
+
+  market_depth session::get_market_depth( const msg::market_depth_request& req ) {
+    std::vector<ltl::depth_level> bids;
+    std::vector<ltl::depth_level> asks;
+
+    market_depth md;
+    md.stock_note_id = req.stock_note_id;
+    md.cur_note_id   = req.cur_note_id;
+    md.seq = my->serv->get_market_depth( req.stock_note_id, req.cur_note_id, 
+                                         req.max_levels ? *req.max_levels : 0, bids, asks );
+    to_rpc( bids, md.bids );
+    to_rpc( asks, md.asks );
+    return md;
+  }
+
+  static void to_rpc( const std::vector<ltl::depth_delta>& deltas, std::vector<depth_update>& updates ) {
+    updates.resize( deltas.size() );
+    for( uint32_t i = 0; i < deltas.size(); ++i ) {
+      updates[i].seq      = deltas[i].seq;
+      updates[i].side     = deltas[i].side == market_order::buy ? "bid" : "ask";
+      updates[i].price    = deltas[i].price;
+      updates[i].quantity = deltas[i].quantity;
+      updates[i].orders   = deltas[i].orders;
+    }
+  }
+
+  market_depth_updates session::get_market_depth_updates( const msg::market_depth_updates_request& req ) {
+    std::vector<ltl::depth_delta> deltas;
+
+    market_depth_updates mdu;
+    mdu.since_seq         = req.since_seq;
+    mdu.seq               = req.since_seq;
+    mdu.snapshot_required = !my->serv->get_market_depth_deltas( req.stock_note_id, req.cur_note_id, 
+                                                                req.since_seq, deltas );
+    to_rpc( deltas, mdu.updates );
+    if( deltas.size() )
+      mdu.seq = deltas.back().seq;
+    return mdu;
+  }
+
+  market_quote session::get_quote( const msg::quote_request& req ) {
+    ltl::book_quote q;
+    if( !my->serv->get_quote( req.stock_note_id, req.cur_note_id, q ) ) {
+      LTL_THROW( "No market for %1%/%2%", %req.stock_note_id %req.cur_note_id );
+    }
+    market_quote mq;
+    mq.stock_note_id = req.stock_note_id;
+    mq.cur_note_id   = req.cur_note_id;
+    mq.seq           = q.seq;
+    mq.bid           = q.bid;
+    mq.bid_quantity  = q.bid_quantity;
+    mq.ask           = q.ask;
+    mq.ask_quantity  = q.ask_quantity;
+    mq.last_price    = q.last_price;
+    return mq;
+  }
+
+  std::string session::watch_market( const msg::watch_market& req ) {
+    if( my->watches.size() >= max_watches ) {
+      LTL_THROW( "At most %1% market watches per session", %max_watches );
+    }
+    market_watch w;
+    w.stock_note_id = req.stock_note_id;
+    w.cur_note_id   = req.cur_note_id;
+    w.sub           = my->serv->watch_market( req.stock_note_id, req.cur_note_id );
+    w.seq           = 0;
+
+    std::string id = boost::lexical_cast<std::string>( ++my->next_watch );
+    my->watches[id] = w;
+    return id;
+  }
+
+  /**
+   *  The updates are conflated, since_seq and seq bracket them but not
+   *  every change in between is listed.
+   */
+  market_depth_updates session::poll_market( const std::string& watch_id ) {
+    std::map<std::string, market_watch>::iterator itr = my->watches.find( watch_id );
+    if( itr == my->watches.end() ) { LTL_THROW( "Unknown market watch '%1%'", %watch_id ); }
+
+    std::vector<ltl::depth_delta> deltas;
+    market_depth_updates mdu;
+    mdu.since_seq         = itr->second.seq;
+    mdu.seq               = itr->second.sub->poll( deltas );
+    mdu.snapshot_required = false;
+    to_rpc( deltas, mdu.updates );
+    itr->second.seq = mdu.seq;
+    return mdu;
+  }
+
+  bool session::unwatch_market( const std::string& watch_id ) {
+    std::map<std::string, market_watch>::iterator itr = my->watches.find( watch_id );
+    if( itr == my->watches.end() )
+      return false;
+    my->serv->unwatch_market( itr->second.stock_note_id, itr->second.cur_note_id, itr->second.sub );
+    my->watches.erase( itr );
+    return true;
+  }
+
+  market_stats session::get_market_stats( const msg::market_stats_request& req ) {
+    std::vector<ltl::candle> candles;
+
+    market_stats ms;
+    ms.stock_note_id = req.stock_note_id;
+    ms.cur_note_id   = req.cur_note_id;
+    ms.window_ms     = req.window_ms     ? *req.window_ms     : 24*60*60*1000;
+    ms.resolution_ms = req.resolution_ms ? *req.resolution_ms : 60*1000;
+
+    ltl::tape_stats st = my->serv->get_market_stats( req.stock_note_id, req.cur_note_id, ms.window_ms, ms.resolution_ms,
+                                                     req.max_candles ? *req.max_candles : 60, candles );
+    ms.last_price = st.last_price;
+    ms.volume     = st.volume;
+    ms.vwap       = st.vwap;
+    ms.trades     = st.trades;
+
+    ms.candles.resize( candles.size() );
+    for( uint32_t i = 0; i < candles.size(); ++i ) {
+      ms.candles[i].start  = candles[i].start;
+      ms.candles[i].open   = candles[i].open;
+      ms.candles[i].high   = candles[i].high;
+      ms.candles[i].low    = candles[i].low;
+      ms.candles[i].close  = candles[i].close;
+      ms.candles[i].volume = candles[i].volume;
+      ms.candles[i].trades = candles[i].trades;
+    }
+    return ms;
   }
 
   std::vector<uint64_t>  session::allocate_signature_numbers( const msg::allocate_signatures& as) {
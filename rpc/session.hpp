@@ -48,10 +48,44 @@ namespace ltl {
                                         
        std::string                      post_market_offer( const market_offer& off );
        std::string                      cancel_market_offer( const std::string& off_id );
+       std::string                      amend_market_offer( const msg::amend_order& am );
+       uint32_t                         cancel_market_offers( const std::string& identity_id );
        std::vector<market_offer>        get_market_offers( const std::string& buy_asset_id, 
                                                            const std::string& sell_asset_id, 
                                                            int64_t max_price );
 
+       /**
+        *  Market data is a snapshot followed by incremental updates,
+        *  clients poll get_market_depth_updates with the last seq they
+        *  have applied instead of fetching the whole book again.
+        */
+       market_depth                     get_market_depth( const msg::market_depth_request& req );
+       market_depth_updates             get_market_depth_updates( const msg::market_depth_updates_request& req );
+
+       /**
+        *  Rolling volume and vwap plus recent candles, maintained as
+        *  trades happen rather than computed from the trade table.
+        */
+       market_stats                     get_market_stats( const msg::market_stats_request& req );
+
+       /**
+        *  Best bid, best ask and last trade, the cheapest market data
+        *  call: it never waits for matching.
+        */
+       market_quote                     get_quote( const msg::quote_request& req );
+
+       /**
+        *  Subscribes to the depth of a pair and returns the id of the
+        *  watch.  poll_market returns the levels that changed since the
+        *  previous poll in their latest state, however many times they
+        *  changed, so a slow client never falls behind.  Watch before
+        *  taking the get_market_depth snapshot and skip updates with a
+        *  seq up to the snapshot's.
+        */
+       std::string                      watch_market( const msg::watch_market& req );
+       market_depth_updates             poll_market( const std::string& watch_id );
+       bool                             unwatch_market( const std::string& watch_id );
+
 
                                         
        std::vector<uint64_t>            allocate_signature_numbers( const msg::allocate_signatures& as);
@@ -61,8 +95,6 @@ namespace ltl {
 
        /** 
         *   Subscribe to events on various objects.  This allows 
-       std::string                      watch_market( const std::string& buy_asset_id, 
-                                                      const std::string& sell_asset_id, const event_handler& eh );
        std::string                      watch_transaction( const std::string& trx_id, const event_handler& eh );
        std::string                      watch_account( const std::string& trx_id, const event_handler& eh );
         */
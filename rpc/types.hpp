@@ -160,6 +160,96 @@ namespace ltl { namespace rpc {
       int64_t     expire_date;
   };
 
+  /**
+   *  The total quantity resting at one price.
+   */
+  struct depth_level {
+      int64_t     price;
+      int64_t     quantity;
+      uint32_t    orders;
+  };
+
+  /**
+   *  Aggregated bids and asks for a stock/currency pair as of seq.
+   *  Bids are sorted highest price first, asks lowest price first.
+   */
+  struct market_depth {
+      std::string              stock_note_id;
+      std::string              cur_note_id;
+      uint64_t                 seq;
+      std::vector<depth_level> bids;
+      std::vector<depth_level> asks;
+  };
+
+  /**
+   *  The new state of the level at price on side "bid" or "ask",
+   *  a quantity of 0 removes the level.
+   */
+  struct depth_update {
+      uint64_t    seq;
+      std::string side;
+      int64_t     price;
+      int64_t     quantity;
+      uint32_t    orders;
+  };
+
+  /**
+   *  Every depth_update after since_seq up to seq.  If snapshot_required
+   *  is set the updates are no longer available and the client must call
+   *  get_market_depth again.
+   */
+  struct market_depth_updates {
+      uint64_t                  since_seq;
+      uint64_t                  seq;
+      bool                      snapshot_required;
+      std::vector<depth_update> updates;
+  };
+
+  /**
+   *  Top of book of a stock/currency pair as of the depth seq, prices and
+   *  quantities are 0 where a side is empty or nothing has traded.
+   */
+  struct market_quote {
+      std::string stock_note_id;
+      std::string cur_note_id;
+      uint64_t    seq;
+      int64_t     bid;
+      int64_t     bid_quantity;
+      int64_t     ask;
+      int64_t     ask_quantity;
+      int64_t     last_price;
+  };
+
+  /**
+   *  Open/high/low/close/volume of the trades in [start, start+resolution).
+   */
+  struct market_candle {
+      int64_t     start;
+      int64_t     open;
+      int64_t     high;
+      int64_t     low;
+      int64_t     close;
+      int64_t     volume;
+      uint32_t    trades;
+  };
+
+  /**
+   *  Trade statistics of a stock/currency pair.  volume, vwap and trades
+   *  cover the last window_ms, candles are the most recent candles at
+   *  resolution_ms, oldest first.
+   */
+  struct market_stats {
+      std::string                stock_note_id;
+      std::string                cur_note_id;
+      int64_t                    last_price;
+      int64_t                    volume;
+      int64_t                    vwap;
+      uint32_t                   trades;
+      uint32_t                   window_ms;
+      uint32_t                   resolution_ms;
+      std::vector<market_candle> candles;
+  };
+
 } } 
 
 #endif
@@ -1,11 +1,23 @@
 #include <ltl/server.hpp>
 #include <ltl/persist.hpp>
 #include <ltl/date_time.hpp>
+#include <ltl/market_writer.hpp>
+#include <ltl/matching_engine.hpp>
+#include <ltl/trade_tape.hpp>
+#include <ltl/funds_ledger.hpp>
+#include <ltl/market_feed.hpp>
+#include <ltl/group_commit.hpp>
+#include <ltl/object_cache.hpp>
 #include <algorithm>
+#include <exception>
 
 #include <Wt/Dbo/Dbo>
 #include <Wt/Dbo/backend/Sqlite3>
 #include <boost/exception/all.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <scrypt/base64.hpp>
 #include <log/log.hpp>
 #include <ltl/error.hpp>
 
@@ -14,29 +26,74 @@ namespace ltl {
 
   class server_private {
     public:
+      typedef boost::recursive_mutex::scoped_lock scoped_lock;
+
       dbo::Session          m_session;
       dbo::backend::Sqlite3 m_sql3;
       server&               self;
-      market*               mark;
+      matching_engine*      engine;
+      market_writer*        writer;
+      funds_ledger          ledger;  // funds held by open orders, shared with the engine
+      market_feed           feed;    // depth subscriptions, published to by the engine
+
+      /// serializes every use of m_session and keeps the orders a client sends to the engine in order
+      boost::recursive_mutex m_mutex;
+      uint32_t               m_writers; // nesting depth of write_lock, guarded by m_mutex
+      group_commit           commits;   // makes the commits of concurrent writers durable together
+
+      /// loaded objects by binary id, guarded by m_mutex
+      object_cache<identity>   identities;
+      object_cache<asset>      assets;
+      object_cache<asset_note> notes;
+      object_cache<account>    accounts;  // invalidated by the fills the writer applies
+
+      /**
+       *  Held by every method that commits to m_session.  Its commits only
+       *  reach the OS (synchronous=NORMAL), so when the outermost write_lock
+       *  is released the caller waits, without the mutex, for the group
+       *  fsync that makes them durable before it returns to its client.
+       *  Each method keeps its own dbo::Transaction so a failed request
+       *  never rolls back the work of the others in its group.
+       */
+      class write_lock {
+        public:
+          write_lock( server_private& s ):m_s(s),m_lock(s.m_mutex),m_committed(false) { ++m_s.m_writers; }
+
+          /**
+           *  Called by the method after its last commit, right before it
+           *  returns.  A method that throws never gets here and does not
+           *  wait.
+           */
+          void committed() { m_committed = true; }
+
+          /// throws if the commits could not be made durable, see group_commit::wait
+          ~write_lock() BOOST_NOEXCEPT_IF(false) {
+            bool outer = --m_s.m_writers == 0;
+            m_lock.unlock();
+            if( outer && m_committed )
+              m_s.commits.wait();
+          }
+        private:
+          server_private& m_s;
+          scoped_lock     m_lock;
+          bool            m_committed;
+      };
 
       ltl::dbo::ptr<ltl::identity>   host_ident; 
 
 
       server_private( const boost::filesystem::path& dbdir, server& s)
-      :m_sql3( (dbdir/"ltl.db").native() ),self(s)
+      :m_sql3( (dbdir/"ltl.db").native() ),self(s),m_writers(0),commits( dbdir/"ltl.db" ),
+       identities( "identity", 4096 ),assets( "asset", 1024 ),notes( "asset_note", 4096 ),accounts( "account", 16384 )
       {
         slog( "creating session" );
+        // commits are made durable a group at a time by commits.wait()
+        m_sql3.executeSql( "PRAGMA journal_mode=WAL" );
+        m_sql3.executeSql( "PRAGMA synchronous=NORMAL" );
         m_session.setConnection(m_sql3);
         m_sql3.setProperty( "show-queries", "true" );
 
-        m_session.mapClass<identity>("identity");
-        m_session.mapClass<private_identity>("private_identity");
-        m_session.mapClass<asset>("asset");
-        m_session.mapClass<asset_note>("asset_note");
-        m_session.mapClass<account>("account");
-        m_session.mapClass<transaction>("transaction");
-        m_session.mapClass<market_order>("market_order");
-        m_session.mapClass<market_trade>("market_trade");
+        map_classes( m_session );
 
        {
           dbo::Transaction trx(m_session);
@@ -51,8 +108,201 @@ namespace ltl {
           trx.commit();
        }
        m_session.flush();
+       migrate_schema();
+       migrate_sig_numbers();
+
+       writer = new market_writer( m_sql3, 50, 4096, &ledger );
+       writer->on_accounts_changed( boost::bind( &object_cache<account>::invalidate, &accounts, _1 ) );
+       engine = new matching_engine( m_session, *writer, boost::thread::hardware_concurrency(), dbdir/"journal",
+                                     load_note_links(), &ledger, &feed );
+      }
+      /**
+       *  createTables() stops at the first table that exists, so a
+       *  database made by an older version is brought up to the mapping
+       *  here: missing tables are created and missing columns added with
+       *  defaults, then the orders that predate the columns are filled in
+       *  from their order transactions.  Does nothing on a current
+       *  database.
+       */
+      void migrate_schema() {
+        static const char* const columns[][3] = {
+          { "market_order", "status",        "integer not null default 0" },
+          { "market_order", "owner",         "text not null default ''" },
+          { "market_order", "stop_price",    "bigint not null default 0" },
+          { "market_order", "funds_account", "text not null default ''" },
+          { "market_trade", "journal_key",   "text not null default ''" }
+        };
+        typedef dbo::collection<market_order::ptr> orders;
+
+        dbo::Transaction trx(m_session);
+        if( !has_table( "order_amend" ) )
+          create_table( "order_amend" );
+
+        bool had_status = has_column( "market_order", "status" );
+        bool had_owner  = has_column( "market_order", "owner" );
+        for( uint32_t i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i ) {
+          if( has_column( columns[i][0], columns[i][1] ) )
+            continue;
+          m_session.execute( std::string( "alter table \"" ) + columns[i][0] + "\" add column \"" +
+                             columns[i][1] + "\" " + columns[i][2] );
+          slog( "added column %1%.%2%", columns[i][0], columns[i][1] );
+        }
+        // orders used to be closed only by running out
+        if( !had_status )
+          m_session.execute( "update \"market_order\" set \"status\" = 1 where \"num_unfilled\" = 0" );
+        if( !had_owner ) {
+          orders old = m_session.find<market_order>();
+          for( orders::const_iterator itr = old.begin(); itr != old.end(); ++itr ) {
+            market_order o( (*itr)->order_trx );
+            market_order::ptr mo = *itr;
+            mo.modify()->owner         = o.owner;
+            mo.modify()->stop_price    = o.stop_price;
+            mo.modify()->funds_account = o.funds_account;
+          }
+        }
+        trx.commit();
+      }
+
+      bool has_table( const std::string& table ) {
+        return m_session.query<int>( "select count(1) from sqlite_master where type = 'table' and name = ?" ).bind( table );
+      }
+
+      /// sqlite keeps the create statement, add column edits it in place
+      bool has_column( const std::string& table, const std::string& column ) {
+        return m_session.query<int>( "select count(1) from sqlite_master where type = 'table' and name = ? and sql like ?" )
+                 .bind( table ).bind( "%\"" + column + "\"%" );
+      }
 
-       mark = new market( m_session );
+      /**
+       *  Runs the statements createTables() would have run for the table.
+       */
+      void create_table( const std::string& table ) {
+        std::string all    = m_session.tableCreationSql();
+        std::string prefix = "create table \"" + table + "\"";
+        bool        found  = false;
+        for( size_t pos = 0; pos < all.size(); ) {
+          size_t end = all.find( ";\n", pos );
+          if( end == std::string::npos )
+            end = all.size();
+          std::string stmt = all.substr( pos, end - pos );
+          if( stmt.compare( 0, prefix.size(), prefix ) == 0 ) {
+            m_session.execute( stmt );
+            found = true;
+          }
+          pos = end + 2;
+        }
+        if( !found ) { LTL_THROW( "Table %1% is not mapped", %table ); }
+        slog( "created table %1%", table );
+      }
+
+      /**
+       *  Databases made before signature numbers were rows keep them as
+       *  base64 blobs of uint64_t in the sig_nums (reserved) and
+       *  new_sig_nums (issued) columns of account.  The blobs are copied
+       *  into sig_number rows and the columns dropped in one transaction,
+       *  they are not null and no longer mapped so no account could be
+       *  added while they exist.
+       */
+      void migrate_sig_numbers() {
+        typedef boost::tuple<std::string, std::string, std::string> blob_row;
+        typedef dbo::collection<blob_row>                             blob_rows;
+
+        dbo::Transaction trx(m_session);
+        if( !has_table( "sig_number" ) )
+          create_table( "sig_number" );
+
+        uint32_t count = 0;
+        if( has_column( "account", "new_sig_nums" ) ) {
+          blob_rows rows = m_session.query<blob_row>( "select \"id\", \"sig_nums\", \"new_sig_nums\" from \"account\"" );
+          for( blob_rows::const_iterator itr = rows.begin(); itr != rows.end(); ++itr ) {
+            std::vector<uint64_t> reserved = decode_sig_nums( itr->get<1>() );
+            std::vector<uint64_t> issued   = decode_sig_nums( itr->get<2>() );
+            if( reserved.empty() && issued.empty() )
+              continue;
+            std::sort( reserved.begin(), reserved.end() );
+            dbo::ptr<account> a = m_session.load<account>( itr->get<0>() );
+            for( uint32_t i = 0; i < reserved.size(); ++i ) {
+              if( i && reserved[i] == reserved[i-1] )
+                continue;
+              m_session.add( new sig_number( a, reserved[i], sig_number::reserved ) );
+              ++count;
+            }
+            std::sort( issued.begin(), issued.end() );
+            for( uint32_t i = 0; i < issued.size(); ++i ) {
+              if( ( i && issued[i] == issued[i-1] ) || std::binary_search( reserved.begin(), reserved.end(), issued[i] ) )
+                continue;
+              m_session.add( new sig_number( a, issued[i], sig_number::issued ) );
+              ++count;
+            }
+          }
+          m_session.flush();
+          m_session.execute( "alter table \"account\" drop column \"sig_nums\"" );
+          m_session.execute( "alter table \"account\" drop column \"new_sig_nums\"" );
+          slog( "migrated %1% signature numbers", count );
+        }
+        // checked on every start, a database that kept them cannot add accounts
+        if( has_column( "account", "sig_nums" ) || has_column( "account", "new_sig_nums" ) ) {
+          LTL_THROW( "account still has the sig_nums columns, new accounts cannot be added" );
+        }
+        trx.commit();
+      }
+
+      static std::vector<uint64_t> decode_sig_nums( const std::string& b64 ) {
+        std::vector<uint64_t> nums;
+        if( b64.empty() )
+          return nums;
+        std::string data = scrypt::base64_decode( b64 );
+        nums.resize( data.size() / sizeof(uint64_t) );
+        if( nums.size() )
+          memcpy( (char*)&nums.front(), data.c_str(), nums.size() * sizeof(uint64_t) );
+        return nums;
+      }
+
+      /**
+       *  Links the notes of every asset that has more than one issuer so
+       *  that their pairs can trade through each other.  Notes issued
+       *  later are linked on the next start.
+       */
+      note_links load_note_links() {
+        typedef dbo::collection<dbo::ptr<asset_note> > notes;
+        note_links links;
+        std::map<std::string, std::string> first; // asset id -> first note seen
+
+        dbo::Transaction trx(m_session);
+        notes all = m_session.find<asset_note>();
+        for( notes::const_iterator itr = all.begin(); itr != all.end(); ++itr ) {
+          std::string a = std::string( (*itr)->asset_type()->get_id() );
+          std::string n = std::string( (*itr)->get_id() );
+          std::map<std::string, std::string>::iterator f = first.find( a );
+          if( f == first.end() )
+            first[a] = n;
+          else
+            links.link( f->second, n );
+        }
+        trx.commit();
+        return links;
+      }
+
+      /**
+       *  Loads the object with the hex id from the cache or, on a miss,
+       *  from the database.  Called with m_mutex held.
+       */
+      template<typename T>
+      dbo::ptr<T> load( object_cache<T>& cache, const std::string& id ) {
+        sha1 bin( id );
+        dbo::Transaction trx(m_session);
+          dbo::ptr<T> obj = cache.find( bin );
+          if( !obj ) {
+            obj = m_session.load<T>( id );
+            cache.insert( bin, obj );
+          }
+        trx.commit();
+        return obj;
+      }
+
+      ~server_private() {
+        delete engine;
+        delete writer; // commits whatever is still queued
       }
   };
 
@@ -66,34 +316,37 @@ namespace ltl {
   }
 
   dbo::ptr<identity> server::get_identity( const std::string& id ) {
-    dbo::Transaction trx(my->m_session);
-      dbo::ptr<identity> ident = my->m_session.load<identity>( id );
-    trx.commit();
-    return ident;
+    server_private::scoped_lock lock(my->m_mutex);
+    return my->load( my->identities, id );
   }
   dbo::ptr<asset> server::get_asset( const std::string& id ) {
-    dbo::Transaction trx(my->m_session);
-      dbo::ptr<asset> ident = my->m_session.load<asset>( id );
-    trx.commit();
-    return ident;
+    server_private::scoped_lock lock(my->m_mutex);
+    return my->load( my->assets, id );
   }
   dbo::ptr<asset_note> server::get_asset_note( const std::string& id ) {
-    dbo::Transaction trx(my->m_session);
-      dbo::ptr<asset_note> ident = my->m_session.load<asset_note>( id );
-    trx.commit();
-    return ident;
+    server_private::scoped_lock lock(my->m_mutex);
+    return my->load( my->notes, id );
   }
   dbo::ptr<transaction> server::get_transaction( const std::string& id ) {
+    server_private::scoped_lock lock(my->m_mutex);
     dbo::Transaction trx(my->m_session);
       dbo::ptr<transaction> ident = my->m_session.load<transaction>( id );
     trx.commit();
     return ident;
   }
   dbo::ptr<account> server::get_account( const std::string& id ) {
-    dbo::Transaction trx(my->m_session);
-      dbo::ptr<account> ident = my->m_session.load<account>( id );
-    trx.commit();
-    return ident;
+    server_private::scoped_lock lock(my->m_mutex);
+    return my->load( my->accounts, id );
+  }
+
+  std::vector<object_cache_stats> server::get_cache_stats() {
+    server_private::scoped_lock lock(my->m_mutex);
+    std::vector<object_cache_stats> s;
+    s.push_back( my->identities.stats() );
+    s.push_back( my->assets.stats() );
+    s.push_back( my->notes.stats() );
+    s.push_back( my->accounts.stats() );
+    return s;
   }
 
   /**
@@ -105,6 +358,7 @@ namespace ltl {
     slog( "generating private keys..." );
     scrypt::generate_keys(pubk,privk);
 
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
 
     dbo::ptr<private_identity> pi(new private_identity( privk ) );
@@ -115,6 +369,7 @@ namespace ltl {
     ident = my->m_session.add(ident);
     ident.modify()->set_private_identity(pi);
     trx.commit();
+    lock.committed();
 
     return ident;
   }
@@ -124,11 +379,13 @@ namespace ltl {
    */
   dbo::ptr<identity>  server::create_identity( const public_key& pk, const std::string& name, 
                                                uint64_t date, const std::string& props, const signature& sig, uint64_t nonce ) {
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
 
     dbo::ptr<ltl::identity> ident( new ltl::identity( pk, name, date, props, sig, nonce ) );
     ident = my->m_session.add(ident);
     trx.commit();
+    lock.committed();
 
     return ident;
   }
@@ -138,19 +395,23 @@ namespace ltl {
 
   dbo::ptr<asset>  server::create_asset( const std::string& name, const std::string& properties ) {
     slog( "Creating asset %1%: %2%", name, properties );
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
     dbo::ptr<asset> a( new asset( name, properties ) );
     a = my->m_session.add(a);
     trx.commit();
+    lock.committed();
     return a;
   }
   dbo::ptr<asset_note> server::create_asset_note(  const dbo::ptr<identity>& issuer, const dbo::ptr<asset>& a,
                                                    const std::string& name, const std::string& props, const signature& sig ) {
 
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
     dbo::ptr<asset_note> an( new asset_note( issuer, a, name, props, sig ) );
     an = my->m_session.add(an);
     trx.commit();
+    lock.committed();
     return an;
   }
 
@@ -159,24 +420,29 @@ namespace ltl {
    */
   dbo::ptr<asset_note> server::create_asset_note(  const dbo::ptr<identity>& issuer, const dbo::ptr<asset>& a,
                                                    const std::string& name, const std::string& props ) {
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
     dbo::ptr<asset_note> an( new asset_note( issuer, a, name, props ) );
     an = my->m_session.add(an);
     trx.commit();
+    lock.committed();
     return an;
   }
 
 
    dbo::ptr<account> server::create_account( const dbo::ptr<identity>& owner, const dbo::ptr<asset_note>& type ) {
+    server_private::write_lock lock(*my);
     dbo::Transaction trx(my->m_session);
     account::ptr ac( new account( my->host_ident, owner, type, 0 ) );
     ac = my->m_session.add(ac);
     trx.commit();
+    lock.committed();
     return ac;
    }
 
 
    dbo::ptr<transaction>  server::transfer( const std::string& desc, int64_t amount, const dbo::ptr<account>& from, const dbo::ptr<account>& to ) {
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
         if( from->get_pending_balance() < amount ) {
           if( from->owner() != from->type()->issuer() )
@@ -190,7 +456,10 @@ namespace ltl {
         dbo::ptr<transaction> trx( new transaction( acts, desc, 0 ) );
         trx = my->m_session.add(trx);
         trx.modify()->post_to_accounts();
+        my->ledger.invalidate( std::string( from->get_id() ) );
+        my->ledger.invalidate( std::string( to->get_id() ) );
       dbtrx.commit();
+      lock.committed();
       return trx;
    }
    std::vector<uint64_t>  server::allocate_signature_numbers( const dbo::ptr<account>& acnt, uint32_t num ) {
@@ -200,9 +469,11 @@ namespace ltl {
         for( uint32_t i = 1; i < sigs.size(); ++i )
           sigs[i] = sigs[0]+i;
       }
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
       acnt.modify()->allocate_signature_numbers( sigs, signature() );
       dbtrx.commit();
+      lock.committed();
       return sigs;
    }
 
@@ -211,6 +482,7 @@ namespace ltl {
     * signs it, asks the account to apply it.
     */
    void  server::accept_applied_transactions( const dbo::ptr<account>& acnt ) {
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
       std::vector<sha1> approved(acnt->get_applied_transactions().size());
       int i = 0;
@@ -239,8 +511,10 @@ namespace ltl {
 
       // apply it, or throw, can only be done by host
       acnt.modify()->host_accept_balance( ownersig, newbal, n, nsids, approved );
+      my->ledger.invalidate( std::string( acnt->get_id() ) );
 
       dbtrx.commit();
+      lock.committed();
    }
 
 
@@ -249,6 +523,7 @@ namespace ltl {
     * signs it, asks the account to apply it.
     */
    void  server::sign_balance_agreement( const dbo::ptr<account>& acnt, uint64_t new_date, const signature& ownersig ) {
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
       std::vector<sha1> approved(acnt->get_applied_transactions().size());
       int i = 0;
@@ -278,8 +553,10 @@ namespace ltl {
 
       // apply it, or throw, can only be done by host
       acnt.modify()->host_accept_balance( ownersig, newbal, n, nsids, approved );
+      my->ledger.invalidate( std::string( acnt->get_id() ) );
 
       dbtrx.commit();
+      lock.committed();
    }
 
    /**
@@ -287,6 +564,7 @@ namespace ltl {
     *  Trx must require acnt signature.
     */
    void server::sign_transaction( const dbo::ptr<transaction>& trx, const dbo::ptr<account>& acnt ) {
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
       boost::optional<uint64_t> sig = trx->get_signature_num_for(acnt->get_id());
       if( sig ) {
@@ -325,6 +603,7 @@ namespace ltl {
       slog("Updating Signature");
       trx.modify()->update_signature( sl );
       dbtrx.commit();
+      lock.committed();
 
    }
 
@@ -338,6 +617,7 @@ namespace ltl {
                                   uint64_t  sig_num,
                                   const signature& sign                            
                                   ) {
+      server_private::write_lock lock(*my);
       dbo::Transaction dbtrx(my->m_session);
       boost::optional<uint64_t> sig = trx->get_signature_num_for(acnt->get_id());
       if( sig ) {
@@ -384,6 +664,7 @@ namespace ltl {
       slog("Updating Signature");
       trx.modify()->update_signature( sl );
       dbtrx.commit();
+      lock.committed();
    }
 
 
@@ -406,8 +687,9 @@ namespace ltl {
                                                  const dbo::ptr<account>& stock_acnt,
                                                  const dbo::ptr<account>& currency_acnt,
                                                  uint64_t num, uint64_t price, uint64_t min_unit,
-                                                 ptime start, ptime end )
+                                                 ptime start, ptime end, uint64_t stop_price )
     {
+       server_private::write_lock lock(*my);
        dbo::Transaction dbtrx(my->m_session);
          std::vector<action::ptr> acts; 
        
@@ -420,6 +702,7 @@ namespace ltl {
          off.offer_price = price;
          off.start = start;
          off.end = end;
+         off.stop_price = stop_price;
          
          acts.push_back( action::ptr( new offer(off) ) );
          std::stringstream ss;
@@ -435,8 +718,177 @@ namespace ltl {
        
        
          market_order::ptr mo( new market_order( trx ) );
-         my->mark->submit_order(mo);
+         // throws before the order is added if its account cannot pay for it
+         market::reserve_funds( my->ledger, mo );
+         std::string order_id( trx->get_id() );
+         try {
+           mo = my->m_session.add(mo);
+           dbtrx.commit();
+           // matched on the worker of the pair once its row exists, the result is recorded by the market writer
+           my->engine->submit_order(mo);
+         } catch ( ... ) {
+           my->ledger.release( order_id );
+           throw;
+         }
+       lock.committed();
+       return mo;
+    }
+
+    static void no_op( market& ) {}
+
+    void server::flush_market() {
+       std::vector< boost::unique_future<void> > done;
+       {
+         server_private::scoped_lock lock(my->m_mutex);
+         for( uint32_t i = 0; i < my->engine->shard_count(); ++i )
+           done.push_back( my->engine->execute<void>( i, &no_op ) );
+       }
+       // everything queued before the no-ops has been matched once they ran
+       for( uint32_t i = 0; i < done.size(); ++i )
+         done[i].wait();
+       my->writer->flush();
+    }
+
+    /**
+     *  Orders are indexed by the shard that holds them, asking every shard
+     *  avoids a database lookup of the order's pair.
+     */
+    bool server::cancel_order( const std::string& order_id ) {
+       server_private::scoped_lock lock(my->m_mutex);
+       std::vector< boost::unique_future<bool> > r;
+       for( uint32_t i = 0; i < my->engine->shard_count(); ++i )
+         r.push_back( my->engine->execute<bool>( i, boost::bind( &market::cancel_order, _1, order_id ) ) );
+       bool found = false;
+       for( uint32_t i = 0; i < r.size(); ++i )
+         found = r[i].get() || found;
+       return found;
+    }
+
+    uint32_t server::cancel_orders( const std::string& owner_id ) {
+       server_private::scoped_lock lock(my->m_mutex);
+       std::vector< boost::unique_future<uint32_t> > r;
+       for( uint32_t i = 0; i < my->engine->shard_count(); ++i )
+         r.push_back( my->engine->execute<uint32_t>( i, boost::bind( &market::cancel_orders, _1, owner_id ) ) );
+       uint32_t count = 0;
+       for( uint32_t i = 0; i < r.size(); ++i )
+         count += r[i].get();
+       return count;
+    }
+
+    bool server::amend_order( const std::string& order_id, long long num_unfilled, long long price,
+                              long long date, const signature& owner_sig ) {
+       server_private::write_lock lock(*my);
+       dbo::Transaction dbtrx(my->m_session);
+         market_order::ptr mo = my->m_session.load<market_order>( my->m_session.load<transaction>( order_id ) );
+         dbo::ptr<identity> owner = my->m_session.load<identity>( mo->owner );
+         if( !owner->get_pub_key().verify( order_amend::digest( order_id, num_unfilled, price, date ), owner_sig ) ) {
+           LTL_THROW( "Invalid signature" );
+         }
+         // a signed amend must not be replayed once the owner has moved on
+         long long now = to_milliseconds( to_ptime(system_clock::now()) );
+         if( date > now + 60*1000 || date < now - 5*60*1000 ) {
+           LTL_THROW( "Amend date %1% is more than 5 minutes old or 1 minute ahead of now, %2%", %date %now );
+         }
+         for( order_amends::const_iterator itr = mo->amends.begin(); itr != mo->amends.end(); ++itr ) {
+           if( (*itr)->date >= date )
+             LTL_THROW( "Amend date %1% is not newer than the last amend of order %2%", %date %order_id );
+         }
+         market::seed_funds( my->ledger, my->m_session, mo->funds_account );
+         bool open = my->engine->execute<bool>( mo->stock_note, mo->cur_note,
+                                  boost::bind( &market::amend_order, _1, order_id, num_unfilled, price ) ).get();
+         if( open )
+           my->m_session.add( new order_amend( mo, num_unfilled, price, date, owner_sig ) );
        dbtrx.commit();
+       lock.committed();
+       return open;
+    }
+
+    bool server::amend_order( const std::string& order_id, long long num_unfilled, long long price ) {
+       long long date = to_milliseconds( to_ptime(system_clock::now()) );
+       signature sig;
+       {
+         server_private::scoped_lock lock(my->m_mutex);
+         dbo::Transaction dbtrx(my->m_session);
+           market_order::ptr  mo    = my->m_session.load<market_order>( my->m_session.load<transaction>( order_id ) );
+           dbo::ptr<identity> owner = my->m_session.load<identity>( mo->owner );
+           for( order_amends::const_iterator itr = mo->amends.begin(); itr != mo->amends.end(); ++itr )
+             date = (std::max)( date, (*itr)->date + 1 );
+           owner->get_priv_key().sign( order_amend::digest( order_id, num_unfilled, price, date ), sig );
+         dbtrx.commit();
+       }
+       return amend_order( order_id, num_unfilled, price, date, sig );
+    }
+
+    std::string server::get_order_owner( const std::string& order_id ) {
+       server_private::scoped_lock lock(my->m_mutex);
+       std::vector< boost::unique_future<std::string> > r;
+       for( uint32_t i = 0; i < my->engine->shard_count(); ++i )
+         r.push_back( my->engine->execute<std::string>( i, boost::bind( &market::order_owner, _1, order_id ) ) );
+       std::string owner;
+       for( uint32_t i = 0; i < r.size(); ++i ) {
+         std::string o = r[i].get();
+         if( o.size() ) owner = o;
+       }
+       return owner;
+    }
+
+    void server::set_call_auction( const dbo::ptr<asset_note>& stock, const dbo::ptr<asset_note>& currency, 
+                                   uint64_t interval_ms ) {
+       server_private::scoped_lock lock(my->m_mutex);
+       std::string sn = stock->get_id();
+       std::string cn = currency->get_id();
+       my->engine->execute<void>( sn, cn, boost::bind( &market::set_call_auction, _1, sn, cn, interval_ms ) ).get();
+    }
+
+    void server::set_tick_range( const dbo::ptr<asset_note>& stock, const dbo::ptr<asset_note>& currency,
+                                 long long min_price, long long max_price ) {
+       server_private::scoped_lock lock(my->m_mutex);
+       std::string sn = stock->get_id();
+       std::string cn = currency->get_id();
+       my->engine->execute<void>( sn, cn, boost::bind( &market::set_tick_range, _1, sn, cn, min_price, max_price ) ).get();
+    }
+
+    /**
+     *  Market data only reads the shard of the pair, it does not wait for
+     *  the server mutex behind orders and account writes.
+     */
+    uint64_t server::get_market_depth( const std::string& stock_note, const std::string& cur_note,
+                                       uint32_t max_levels,
+                                       std::vector<depth_level>& bids, std::vector<depth_level>& asks ) {
+       return my->engine->execute<uint64_t>( stock_note, cur_note,
+                boost::bind( &market::get_depth, _1, stock_note, cur_note, max_levels,
+                             boost::ref(bids), boost::ref(asks) ) ).get();
+    }
+
+    bool server::get_market_depth_deltas( const std::string& stock_note, const std::string& cur_note,
+                                          uint64_t since_seq, std::vector<depth_delta>& deltas ) {
+       return my->engine->execute<bool>( stock_note, cur_note,
+                boost::bind( &market::get_depth_deltas, _1, stock_note, cur_note, since_seq, 
+                             boost::ref(deltas) ) ).get();
+    }
+
+    tape_stats server::get_market_stats( const std::string& stock_note, const std::string& cur_note,
+                                         long long window_ms, uint32_t resolution_ms, uint32_t max_candles,
+                                         std::vector<candle>& candles ) {
+       return my->engine->execute<tape_stats>( stock_note, cur_note,
+                boost::bind( &market::get_stats, _1, stock_note, cur_note, window_ms, resolution_ms,
+                             max_candles, boost::ref(candles) ) ).get();
+    }
+
+    /**
+     *  The feed has its own lock, subscribing never waits for the engine.
+     */
+    market_subscription_ptr server::watch_market( const std::string& stock_note, const std::string& cur_note ) {
+       return my->feed.subscribe( stock_note, cur_note );
+    }
+
+    bool server::get_quote( const std::string& stock_note, const std::string& cur_note, book_quote& q ) {
+       return my->feed.get_quote( stock_note, cur_note, q );
+    }
+
+    void server::unwatch_market( const std::string& stock_note, const std::string& cur_note,
+                                 const market_subscription_ptr& s ) {
+       my->feed.unsubscribe( stock_note, cur_note, s );
     }
 
 
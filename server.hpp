@@ -7,6 +7,10 @@
 
 namespace ltl {
 
+  class market_subscription;
+  struct book_quote;
+  struct object_cache_stats;
+
   /**
    *  The central location that manages the market database
    *  and performs common actions.  
@@ -25,6 +29,12 @@ namespace ltl {
      dbo::ptr<account>      get_account( const std::string& id );
      dbo::ptr<transaction>  get_transaction( const std::string& id );
 
+     /**
+      *  Hits, misses and evictions of the caches that get_identity,
+      *  get_asset, get_asset_note and get_account are served from.
+      */
+     std::vector<object_cache_stats> get_cache_stats();
+
 
      dbo::ptr<identity>     create_identity( const std::string& name, const std::string& properties ); 
 
@@ -58,7 +68,107 @@ namespace ltl {
                                           const dbo::ptr<account>& stock_acnt,
                                           const dbo::ptr<account>& currency_acnt,
                                           uint64_t num, uint64_t price, uint64_t min_unit,
-                                          ptime start, ptime end );
+                                          ptime start, ptime end, uint64_t stop_price = 0 );
+
+     /**
+      *  Waits until the trades and order changes made so far by the
+      *  market have been committed to the database.
+      */
+     void                   flush_market();
+
+     /**
+      *  Cancels the open order created by the transaction order_id.
+      *  @return false if it is not open
+      */
+     bool                   cancel_order( const std::string& order_id );
+
+     /**
+      *  Cancels every open order owned by the identity.
+      *  @return the number of orders cancelled
+      */
+     uint32_t               cancel_orders( const std::string& owner_id );
+
+     /**
+      *  Changes the unfilled quantity and price of the open order created
+      *  by the transaction order_id.  A reduction at the same price keeps
+      *  the order's place in its queue, a new price puts it at the back.
+      *  owner_sig signs order_amend::digest() with the key of the order's
+      *  owner.  date must be newer than the order's last amend, at most
+      *  5 minutes old and at most 1 minute ahead of the server's clock,
+      *  so that a signed amend cannot be replayed.
+      *
+      *  @return false if the order is not open
+      */
+     bool                   amend_order( const std::string& order_id, long long num_unfilled, long long price,
+                                         long long date, const signature& owner_sig );
+
+     /**
+      *  Signs the amend with the private key of the order's owner, which
+      *  must be hosted here.
+      */
+     bool                   amend_order( const std::string& order_id, long long num_unfilled, long long price );
+
+     /**
+      *  @return the identity id owning the open order or an empty string
+      */
+     std::string            get_order_owner( const std::string& order_id );
+
+     /**
+      *  Bounds the prices of the pair to min_price .. max_price so that
+      *  its book steps between levels with an occupancy bitmap, see
+      *  order_book::set_tick_range.  A max_price of 0 removes the bound.
+      */
+     void                   set_tick_range( const dbo::ptr<asset_note>& stock,
+                                            const dbo::ptr<asset_note>& currency,
+                                            long long min_price, long long max_price );
+
+     /**
+      *  Switches the stock/currency pair between continuous matching
+      *  (interval_ms == 0) and a call auction run every interval_ms.
+      */
+     void                   set_call_auction( const dbo::ptr<asset_note>& stock, 
+                                              const dbo::ptr<asset_note>& currency,
+                                              uint64_t interval_ms );
+
+     /**
+      *  Snapshot of the aggregated book for a pair of asset note ids.
+      *  @return the depth sequence number of the snapshot
+      */
+     uint64_t               get_market_depth( const std::string& stock_note, const std::string& cur_note,
+                                              uint32_t max_levels,
+                                              std::vector<depth_level>& bids, std::vector<depth_level>& asks );
+
+     /**
+      *  Depth changes after since_seq, returns false if they are no longer
+      *  available and a new snapshot is required.
+      */
+     bool                   get_market_depth_deltas( const std::string& stock_note, const std::string& cur_note,
+                                                     uint64_t since_seq, std::vector<depth_delta>& deltas );
+
+     /**
+      *  Rolling volume/vwap over window_ms and the most recent candles of
+      *  a pair, see market::get_stats.
+      */
+     tape_stats             get_market_stats( const std::string& stock_note, const std::string& cur_note,
+                                              long long window_ms, uint32_t resolution_ms, uint32_t max_candles,
+                                              std::vector<candle>& candles );
+
+     /**
+      *  Conflated depth updates of a pair, see market_subscription.  A
+      *  subscription receives changes until it is unwatched.  Throws if
+      *  the pair has no market.
+      */
+     boost::shared_ptr<market_subscription> watch_market( const std::string& stock_note, const std::string& cur_note );
+     void                   unwatch_market( const std::string& stock_note, const std::string& cur_note,
+                                            const boost::shared_ptr<market_subscription>& s );
+
+     /**
+      *  Best bid, best ask and last price of a pair, read from the quote
+      *  the pair's book publishes without involving its matching thread.
+      *
+      *  @return false if the pair has no book
+      */
+     bool                   get_quote( const std::string& stock_note, const std::string& cur_note, book_quote& q );
 
     private:
       class server_private* my;
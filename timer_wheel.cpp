@@ -0,0 +1,128 @@
+#include <ltl/timer_wheel.hpp>
+#include <string.h>
+
+namespace ltl {
+
+timer_wheel::timer_wheel( long long now )
+:m_current(now) {
+  memset( m_occupied, 0, sizeof(m_occupied) );
+}
+
+void timer_wheel::place( timer_entry& e, int lvl, int idx ) {
+  m_wheel[lvl][idx].push_back(e);
+  m_occupied[lvl][idx/64] |= 1ull << (idx%64);
+}
+
+void timer_wheel::schedule( timer_entry& e, long long when ) {
+  e.cancel();
+  e.when = when;
+
+  long long delta = when - m_current;
+  if( delta <= 0 ) {
+    place( e, 0, m_current & slot_mask );
+    return;
+  }
+  for( int lvl = 0; lvl < levels; ++lvl ) {
+    if( delta < (1ll << (slot_bits * (lvl+1))) ) {
+      place( e, lvl, (when >> (slot_bits * lvl)) & slot_mask );
+      return;
+    }
+  }
+  m_overflow.push_back(e);
+}
+
+/**
+ *  Moves every entry in s to the slot that matches its remaining time.
+ */
+void timer_wheel::cascade( slot& s ) {
+  slot tmp;
+  tmp.splice( tmp.end(), s );
+  while( !tmp.empty() ) {
+    timer_entry& e = tmp.front();
+    tmp.pop_front();
+    schedule( e, e.when );
+  }
+}
+
+/**
+ *  @return the first occupied slot of lvl at or after from, or -1.
+ *  Stale bits found along the way are cleared.
+ */
+int timer_wheel::next_slot( int lvl, int from ) {
+  for( int w = from / 64; w < slots / 64; ++w ) {
+    uint64_t bits = m_occupied[lvl][w];
+    if( w == from / 64 ) 
+      bits &= ~0ull << (from % 64);
+    while( bits ) {
+      int idx = w * 64 + __builtin_ctzll(bits);
+      if( !m_wheel[lvl][idx].empty() )
+        return idx;
+      m_occupied[lvl][w] &= ~(1ull << (idx % 64));
+      bits &= bits - 1;
+    }
+  }
+  return -1;
+}
+
+/**
+ *  The first tick after m_current at which a slot fires or cascades.
+ */
+long long timer_wheel::next_event() {
+  long long next = -1;
+  for( int lvl = 0; lvl < levels; ++lvl ) {
+    int       shift = slot_bits * lvl;
+    long long span  = 1ll << (shift + slot_bits);
+    long long base  = (m_current >> (shift + slot_bits)) << (shift + slot_bits);
+    int       cur   = (m_current >> shift) & slot_mask;
+
+    // slot cur of an outer wheel was cascaded when this revolution began
+    long long t   = -1;
+    int       idx = cur + 1 < slots ? next_slot( lvl, cur + 1 ) : -1;
+    if( idx >= 0 ) 
+      t = base + ((long long)idx << shift);
+    else if( (idx = next_slot( lvl, 0 )) >= 0 && idx <= cur )
+      t = base + span + ((long long)idx << shift);
+
+    if( t > m_current && ( next < 0 || t < next ) )
+      next = t;
+  }
+  if( !m_overflow.empty() ) {
+    long long span = 1ll << (slot_bits * levels);
+    long long t    = ((m_current / span) + 1) * span;
+    if( next < 0 || t < next ) 
+      next = t;
+  }
+  return next;
+}
+
+timer_entry* timer_wheel::pop_due( long long now ) {
+  while( true ) {
+    slot& s = m_wheel[0][m_current & slot_mask];
+    if( !s.empty() ) {
+      timer_entry& e = s.front();
+      s.pop_front();
+      return &e;
+    }
+    if( m_current >= now )
+      return 0;
+
+    // nothing fires or cascades between here and next
+    long long next = next_event();
+    if( next < 0 || next > now ) {
+      m_current = now;
+      return 0;
+    }
+    m_current = next;
+
+    // when a wheel wraps, pull the next slot of the wheel above it inward
+    for( int lvl = 1; lvl < levels; ++lvl ) {
+      if( (m_current >> (slot_bits * (lvl-1))) & slot_mask )
+        break;
+      cascade( m_wheel[lvl][(m_current >> (slot_bits * lvl)) & slot_mask] );
+      if( lvl == levels - 1 && !((m_current >> (slot_bits * lvl)) & slot_mask) )
+        cascade( m_overflow );
+    }
+  }
+}
+
+} // namespace ltl
@@ -0,0 +1,74 @@
+#ifndef _LTL_TIMER_WHEEL_HPP_
+#define _LTL_TIMER_WHEEL_HPP_
+#include <boost/intrusive/list.hpp>
+#include <stdint.h>
+
+namespace ltl {
+
+  struct timer_tag;
+  typedef boost::intrusive::list_base_hook< boost::intrusive::tag<timer_tag>,
+                                            boost::intrusive::link_mode<boost::intrusive::auto_unlink> > timer_hook;
+
+  /**
+   *  Anything that can be scheduled on a timer_wheel.  Entries unlink
+   *  themselves from the wheel when they are destroyed, so deleting the
+   *  owner of an entry cancels its timer.
+   */
+  struct timer_entry : public timer_hook {
+    timer_entry():when(0){}
+
+    bool is_scheduled()const { return is_linked(); }
+    void cancel()            { unlink(); }
+
+    long long when; // utc ms
+  };
+
+  /**
+   *  Hierarchical timing wheel with millisecond resolution.
+   *
+   *  Four wheels of 256 slots cover 2^32 ms (~49 days) ahead of the current
+   *  time, anything further out waits in an overflow list that is revisited
+   *  each time the outermost wheel turns.  Scheduling and cancelling are
+   *  O(1), entries are cascaded towards the inner wheel at most once per
+   *  level before they expire.  Each wheel keeps a bitmap of occupied
+   *  slots so that advancing over idle time jumps straight to the next
+   *  slot that holds anything instead of stepping every millisecond.
+   */
+  class timer_wheel {
+    public:
+      timer_wheel( long long now );
+
+      /**
+       *  Schedules e to expire at when, replacing any earlier schedule.
+       *  Times at or before the current time expire on the next pop_due().
+       */
+      void schedule( timer_entry& e, long long when );
+
+      /**
+       *  Removes and returns the next entry due at or before now, or
+       *  0 once everything up to now has expired.  It is safe to schedule
+       *  entries between calls.
+       */
+      timer_entry* pop_due( long long now );
+
+      long long current()const { return m_current; }
+
+    private:
+      typedef boost::intrusive::list< timer_entry, boost::intrusive::base_hook<timer_hook>,
+                                      boost::intrusive::constant_time_size<false> > slot;
+      enum { levels = 4, slot_bits = 8, slots = 1 << slot_bits, slot_mask = slots - 1 };
+
+      void      cascade( slot& s );
+      void      place( timer_entry& e, int lvl, int idx );
+      int       next_slot( int lvl, int from );
+      long long next_event();
+
+      long long m_current;  // every slot before this tick has been expired
+      slot      m_wheel[levels][slots];
+      uint64_t  m_occupied[levels][slots/64]; // may have stale bits for slots emptied by cancel
+      slot      m_overflow;
+  };
+
+} // namespace ltl
+
+#endif
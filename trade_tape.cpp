@@ -0,0 +1,97 @@
+#include <ltl/trade_tape.hpp>
+#include <ltl/error.hpp>
+#include <algorithm>
+
+namespace ltl {
+
+  static std::vector<uint32_t> make_resolutions() {
+    std::vector<uint32_t> r;
+    r.push_back( 1000 );          // 1 second
+    r.push_back( 60*1000 );       // 1 minute
+    r.push_back( 5*60*1000 );     // 5 minutes
+    r.push_back( 60*60*1000 );    // 1 hour
+    r.push_back( 24*60*60*1000 ); // 1 day
+    return r;
+  }
+
+  const std::vector<uint32_t>& trade_tape::resolutions() {
+    static const std::vector<uint32_t> r = make_resolutions();
+    return r;
+  }
+
+  trade_tape::trade_tape()
+  :m_trades( max_trades ) {
+    m_candles.resize( resolutions().size(), candle_ring( max_candles ) );
+  }
+
+  void trade_tape::add( long long price, long long num, long long timestamp ) {
+    tape_trade t;
+    t.price     = price;
+    t.num       = num;
+    t.timestamp = timestamp;
+    m_trades.push_back( t );
+
+    const std::vector<uint32_t>& res = resolutions();
+    for( uint32_t i = 0; i < res.size(); ++i ) {
+      candle_ring& cr    = m_candles[i];
+      long long    start = timestamp - timestamp % res[i];
+      // a trade stamped before the current candle still counts towards it
+      if( cr.empty() || start > cr.back().start ) {
+        candle c;
+        c.start    = start;
+        c.open     = c.high = c.low = c.close = price;
+        c.volume   = 0;
+        c.notional = 0;
+        c.trades   = 0;
+        cr.push_back( c );
+      }
+      candle& c = cr.back();
+      c.high      = (std::max)( c.high, price );
+      c.low       = (std::min)( c.low, price );
+      c.close     = price;
+      c.volume   += num;
+      c.notional += price * num;
+      ++c.trades;
+    }
+  }
+
+  void trade_tape::get_candles( uint32_t resolution_ms, uint32_t max, std::vector<candle>& out )const {
+    const std::vector<uint32_t>& res = resolutions();
+    std::vector<uint32_t>::const_iterator itr = std::find( res.begin(), res.end(), resolution_ms );
+    if( itr == res.end() ) {
+      LTL_THROW( "Unsupported candle resolution %1% ms", %resolution_ms );
+    }
+    const candle_ring& cr = m_candles[itr - res.begin()];
+    uint32_t n = (std::min)( size_t(max), cr.size() );
+    out.insert( out.end(), cr.end() - n, cr.end() );
+  }
+
+  void trade_tape::get_trades( uint32_t max, std::vector<tape_trade>& out )const {
+    uint32_t n = (std::min)( size_t(max), m_trades.size() );
+    out.insert( out.end(), m_trades.end() - n, m_trades.end() );
+  }
+
+  tape_stats trade_tape::rolling( long long now, long long window_ms )const {
+    tape_stats st;
+    if( m_trades.size() )
+      st.last_price = m_trades.back().price;
+
+    const std::vector<uint32_t>& res = resolutions();
+    uint32_t r = 0;
+    while( r + 1 < res.size() && (long long)res[r] * max_candles < window_ms )
+      ++r;
+
+    long long from = now - window_ms;
+    from -= from % res[r];
+    const candle_ring& cr = m_candles[r];
+    for( candle_ring::const_reverse_iterator itr = cr.rbegin(); itr != cr.rend() && itr->start >= from; ++itr ) {
+      st.volume   += itr->volume;
+      st.notional += itr->notional;
+      st.trades   += itr->trades;
+    }
+    if( st.volume )
+      st.vwap = st.notional / st.volume;
+    return st;
+  }
+
+} // namespace ltl
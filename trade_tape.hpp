@@ -0,0 +1,91 @@
+#ifndef _LTL_TRADE_TAPE_HPP_
+#define _LTL_TRADE_TAPE_HPP_
+#include <boost/circular_buffer.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace ltl {
+
+  struct tape_trade {
+    long long price;
+    long long num;
+    long long timestamp; // utc ms
+  };
+
+  /**
+   *  Open, high, low, close and volume of the trades in
+   *  [start, start + resolution).
+   */
+  struct candle {
+    long long start;
+    long long open;
+    long long high;
+    long long low;
+    long long close;
+    long long volume;
+    long long notional; // sum of price * num
+    uint32_t  trades;
+  };
+
+  /**
+   *  Totals of the trades within a window, vwap is notional / volume.
+   */
+  struct tape_stats {
+    tape_stats():last_price(0),volume(0),notional(0),vwap(0),trades(0){}
+
+    long long last_price;
+    long long volume;
+    long long notional;
+    long long vwap;
+    uint32_t  trades;
+  };
+
+  /**
+   *  The most recent trades of one pair along with candles at several
+   *  resolutions.  add() is O(1): it appends to a ring of trades and
+   *  updates or starts the current candle of each resolution, nothing is
+   *  recomputed from history.  Old trades and candles fall off the end of
+   *  their rings.
+   */
+  class trade_tape {
+    public:
+      enum {
+        max_trades  = 1024,  // trades kept on the tape
+        max_candles = 512    // candles kept per resolution
+      };
+
+      trade_tape();
+
+      void add( long long price, long long num, long long timestamp );
+
+      /// resolutions in ms that get_candles() accepts, finest first
+      static const std::vector<uint32_t>& resolutions();
+
+      /**
+       *  Copies up to max of the most recent candles at resolution_ms,
+       *  oldest first.  Periods without trades have no candle.
+       */
+      void get_candles( uint32_t resolution_ms, uint32_t max, std::vector<candle>& out )const;
+
+      /**
+       *  Copies up to max of the most recent trades, oldest first.
+       */
+      void get_trades( uint32_t max, std::vector<tape_trade>& out )const;
+
+      /**
+       *  Volume and vwap of the trades within window_ms before now.  Uses
+       *  the finest candles that still cover the window, so the window
+       *  is rounded to that resolution.
+       */
+      tape_stats rolling( long long now, long long window_ms )const;
+
+    private:
+      typedef boost::circular_buffer_space_optimized<candle> candle_ring;
+
+      boost::circular_buffer_space_optimized<tape_trade> m_trades;
+      std::vector<candle_ring>                           m_candles; // one per resolution
+  };
+
+} // namespace ltl
+
+#endif
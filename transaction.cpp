@@ -216,6 +216,21 @@ namespace ltl {
     // move trx from in box to out box
   }
 
+  void transaction::apply_by_host() {
+    std::vector<sha1> req_sig = get_required_signatures();
+    std::vector<account::ptr> acnts;
+    for( uint32_t i = 0; i < req_sig.size(); ++i ) {
+      dbo::ptr<account> acnt = session()->load<account>( std::string(req_sig[i]) );
+      acnts.push_back( acnt );
+      m_ref_out_accounts.insert( acnt );
+    }
+    sign_host();
+    for( uint32_t i = 0; i < acnts.size(); ++i ) {
+      m_ref_applied_accounts.insert( acnts[i] );
+      m_ref_out_accounts.erase( acnts[i] );
+    }
+  }
+
   bool transaction::sign_host(){
     scrypt::sha1_encoder enc;
     const std::vector<signature_line>& sl = get_signatures();
@@ -98,6 +98,15 @@ namespace ltl {
         void post_to_accounts();
         bool sign_host();
 
+        /**
+         *  Signs as the host and applies the transaction to every account
+         *  it references without waiting for their signatures.  Only for
+         *  transactions authorized by an earlier one, such as the fills
+         *  of a signed market offer.  The transaction must have been
+         *  added to a session.
+         */
+        void apply_by_host();
+
         const std::string& get_host_signature_b64()const;
         const std::string& get_host_note()const;
       private: